@@ -0,0 +1,135 @@
+#include <algorithm>
+#include "generator.hpp"
+
+Generator::Generator(const Options &options) : _options(options), _random(options.seed), _rules(0), _rootRules(0), _rootVariables(0), _lines(0)
+{
+  size_t fragment = (options.includes > 0 ? std::max<size_t>(options.lines / 10 / options.includes, 1) : 0);
+
+  this->_files.push_back({"Makefile", ""});
+  for (size_t depth = 1; depth <= options.includes; depth++)
+    this->_files.push_back({"include_" + std::to_string(depth) + ".mk", ""});
+  for (size_t i = 0; i < this->_files.size(); i++) {
+    std::string &out = this->_files[i].content;
+
+    if (i == 0) {
+      out += ".PHONY: all clean\nall: target_0\nclean:\n\trm -f *.o\n";
+      this->_lines += 4;
+    }
+    if (i + 1 < this->_files.size()) {
+      out += "include " + this->_files[i + 1].name + "\n";
+      this->_lines++;
+    }
+    if (i > 0) {
+      this->_generate(out, fragment, "inc" + std::to_string(i) + "_");
+      continue;
+    }
+    this->_rootVariables = this->_generate(out, options.lines, "");
+    this->_rootRules = this->_rules;
+  }
+}
+
+const std::vector<Generator::File> &Generator::files() const
+{
+  return this->_files;
+}
+
+const std::string &Generator::makefile() const
+{
+  return this->_files[0].content;
+}
+
+std::string Generator::rules() const
+{
+  std::string required;
+  std::string forbidden;
+
+  for (size_t i = 0; i < this->_options.patterns; i++) {
+    required += (i == 0 ? "\"target_" : ", \"target_") + std::to_string(i * 7) + "\"";
+    forbidden += (i == 0 ? "\"forbidden_" : ", \"forbidden_") + std::to_string(i) + "*\"";
+  }
+  return "{\n"
+         "  \"include\": {\"rules\": [\"all\", \"clean\"" + (required.empty() ? "" : ", " + required) + "], \"variables\": [\"VAR_0\"]},\n"
+         "  \"exclude\": {\"rules\": [" + forbidden + "], \"variables\": [\"LEGACY_*\"]},\n"
+         "  \"graph\": {\"checks\": [\"cycles\", \"unreachable\", \"phony\"], \"root\": \"all\"}\n"
+         "}\n";
+}
+
+size_t Generator::lines() const
+{
+  return this->_lines;
+}
+
+size_t Generator::missing() const
+{
+  size_t missing = (this->_rootVariables == 0 ? 1 : 0);
+
+  for (size_t i = 0; i < this->_options.patterns; i++) {
+    if (i * 7 >= this->_rootRules)
+      missing++;
+  }
+  return missing;
+}
+
+size_t Generator::bytes() const
+{
+  size_t bytes = 0;
+
+  for (const File &file: this->_files)
+    bytes += file.content.size();
+  return bytes;
+}
+
+size_t Generator::_generate(std::string &out, size_t lines, const std::string &prefix)
+{
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  size_t produced = 0;
+  size_t variables = 0;
+
+  while (produced < lines) {
+    double roll = chance(this->_random);
+
+    if (roll < this->_options.variables)
+      this->_variable(out, prefix + "VAR_" + std::to_string(variables++), produced);
+    else if (roll < this->_options.variables + 0.05) {
+      out += "# " + prefix + "section " + std::to_string(produced) + "\n";
+      produced++;
+    }
+    else
+      this->_rule(out, prefix, produced);
+  }
+  this->_lines += produced;
+  return variables;
+}
+
+void Generator::_variable(std::string &out, const std::string &name, size_t &lines)
+{
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  double roll = chance(this->_random);
+  const char *op = (roll < 0.7 ? "=" : roll < 0.9 ? ":=" : "+=");
+
+  if (chance(this->_random) < this->_options.continuations) {
+    out += name + " " + op + " -W -Wall \\\n\t-O2 -g \\\n\t-I include\n";
+    lines += 3;
+    return;
+  }
+  out += name + " " + op + " $(addprefix ./src/, " + name + ".cpp util.cpp) # sources\n";
+  lines++;
+}
+
+void Generator::_rule(std::string &out, const std::string &prefix, size_t &lines)
+{
+  size_t id = this->_rules++;
+  std::string target = prefix + "target_" + std::to_string(id);
+
+  out += target + ": src/" + std::to_string(id) + ".cpp";
+  if (id > 0)
+    out += " target_" + std::to_string(std::uniform_int_distribution<size_t>(0, id - 1)(this->_random));
+  out += "\n";
+  for (size_t i = 0; i < this->_options.recipe; i++)
+    out += "\t$(CXX) $(CXXFLAGS) -c $< -o $@\n";
+  lines += 1 + this->_options.recipe;
+  if (id % 10 == 0) {
+    out += ".PHONY: " + target + "\n";
+    lines++;
+  }
+}
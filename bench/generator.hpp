@@ -0,0 +1,44 @@
+#ifndef __GENERATOR_HPP
+#define __GENERATOR_HPP
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+class Generator {
+public:
+  struct Options {
+    size_t lines = 100000;
+    double variables = 0.3;
+    size_t recipe = 3;
+    double continuations = 0.1;
+    size_t includes = 0;
+    size_t patterns = 64;
+    uint32_t seed = 42;
+  };
+  struct File {
+    std::string name;
+    std::string content;
+  };
+  Generator(const Options &options);
+  const std::vector<File> &files() const;
+  const std::string &makefile() const;
+  std::string rules() const;
+  size_t lines() const;
+  size_t bytes() const;
+  size_t missing() const;
+private:
+  size_t _generate(std::string &out, size_t lines, const std::string &prefix);
+  void _variable(std::string &out, const std::string &name, size_t &lines);
+  void _rule(std::string &out, const std::string &prefix, size_t &lines);
+  Options _options;
+  std::mt19937 _random;
+  std::vector<File> _files;
+  size_t _rules;
+  size_t _rootRules;
+  size_t _rootVariables;
+  size_t _lines;
+};
+
+#endif
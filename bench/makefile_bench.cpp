@@ -0,0 +1,233 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "generator.hpp"
+#include "include_cache.hpp"
+#include "makefile.hpp"
+#include "rules.hpp"
+#include "stats.hpp"
+
+class MakefileBench {
+public:
+  static void clean(Makefile &makefile)
+  {
+    std::pmr::vector<Makefile::Line>(makefile._arena.resource()).swap(makefile._makefile);
+    std::fill(std::begin(makefile._counts), std::end(makefile._counts), 0);
+    makefile._recipePrefix = '\t';
+    makefile._recipePrefixes = 0;
+    makefile._conditionals = 0;
+    makefile._cleanMakefile(makefile._content);
+  }
+  static void resetVariables(Makefile &makefile)
+  {
+    makefile._generation++;
+    Makefile::Variables(makefile._arena.resource()).swap(makefile._variables);
+  }
+  static void extractVariables(Makefile &makefile)
+  {
+    makefile._extractVariables();
+  }
+  static void resetReceipes(Makefile &makefile)
+  {
+    std::pmr::vector<Makefile::Receipe>(makefile._arena.resource()).swap(makefile._receipes);
+    std::pmr::vector<std::string_view>(makefile._arena.resource()).swap(makefile._cmds);
+    std::pmr::vector<Makefile::Receipe>(makefile._arena.resource()).swap(makefile._phonies);
+    makefile._phony = std::string_view();
+  }
+  static void extractReceipes(Makefile &makefile)
+  {
+    makefile._extractReceipes();
+  }
+  static void extractPhony(Makefile &makefile)
+  {
+    makefile._extractPhony();
+  }
+};
+
+struct Bench {
+  size_t iterations;
+  size_t lines;
+  size_t bytes;
+};
+
+class CountingSink : public DiagnosticSink {
+public:
+  void report(const Diagnostic &diagnostic) override
+  {
+    if (diagnostic.kind == Diagnostic::ForbiddenRule || diagnostic.kind == Diagnostic::ForbiddenVariable)
+      this->forbidden++;
+    else if (diagnostic.kind == Diagnostic::MissingRule || diagnostic.kind == Diagnostic::MissingVariable)
+      this->missing++;
+  }
+  size_t forbidden = 0;
+  size_t missing = 0;
+};
+
+static void removeFiles(const std::string &directory)
+{
+  DIR *dir = opendir(directory.c_str());
+
+  if (dir == nullptr)
+    return;
+  for (struct dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    if (entry->d_name[0] != '.')
+      unlink((directory + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+}
+
+template <typename Setup, typename Body>
+static void run(const Bench &bench, const std::string &name, Setup &&setup, Body &&body)
+{
+  double best = 0;
+  size_t count = 0;
+  size_t size = 0;
+
+  for (size_t i = 0; i < bench.iterations; i++) {
+    setup();
+    size_t firstCount = Stats::allocations();
+    size_t firstSize = Stats::allocatedBytes();
+    auto begin = std::chrono::steady_clock::now();
+
+    body();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    count = Stats::allocations() - firstCount;
+    size = Stats::allocatedBytes() - firstSize;
+    if (i == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+  std::cout << "{\"bench\":\"" << name << "\""
+            << ",\"lines\":" << bench.lines
+            << ",\"bytes\":" << bench.bytes
+            << ",\"iterations\":" << bench.iterations
+            << ",\"ns\":" << static_cast<uint64_t>(best * 1e9)
+            << ",\"ns_per_line\":" << (best * 1e9 / std::max<size_t>(bench.lines, 1))
+            << ",\"bytes_per_s\":" << static_cast<uint64_t>(bench.bytes / best)
+            << ",\"allocations\":" << count
+            << ",\"allocated_bytes\":" << size << "}\n";
+}
+
+static void usage(const char *name)
+{
+  std::cerr << "Usage: " << name << " [--lines n] [--variables ratio] [--recipe n] [--continuations ratio]"
+            << " [--includes depth] [--patterns n] [--iterations n] [--seed n]" << std::endl;
+}
+
+static bool parse(int argc, char **argv, Generator::Options &options, size_t &iterations)
+{
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+
+    if (i + 1 >= argc)
+      return false;
+    std::string value = argv[++i];
+
+    if (option == "--lines")
+      options.lines = std::stoul(value);
+    else if (option == "--variables")
+      options.variables = std::stod(value);
+    else if (option == "--recipe")
+      options.recipe = std::stoul(value);
+    else if (option == "--continuations")
+      options.continuations = std::stod(value);
+    else if (option == "--includes")
+      options.includes = std::stoul(value);
+    else if (option == "--patterns")
+      options.patterns = std::stoul(value);
+    else if (option == "--iterations")
+      iterations = std::max<size_t>(std::stoul(value), 1);
+    else if (option == "--seed")
+      options.seed = std::stoul(value);
+    else
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  Generator::Options options;
+  size_t iterations = 5;
+  char directory[] = "/tmp/checkmake_bench.XXXXXX";
+
+  Stats::enable();
+  try {
+    if (!parse(argc, argv, options, iterations)) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  catch (const std::exception &e) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (mkdtemp(directory) == nullptr) {
+    std::cerr << "Error: cannot create a temporary directory" << std::endl;
+    return 1;
+  }
+
+  Generator generator(options);
+  std::string root = std::string(directory) + "/" + generator.files()[0].name;
+  std::string rulesPath = std::string(directory) + "/rules.json";
+  std::string cacheDirectory = std::string(directory) + "/cache";
+  Bench single = {iterations, static_cast<size_t>(std::count(generator.makefile().begin(), generator.makefile().end(), '\n')), generator.makefile().size()};
+  Bench total = {iterations, generator.lines(), generator.bytes()};
+  std::unique_ptr<Makefile> makefile;
+  std::unique_ptr<IncludeCache> includes;
+  std::unique_ptr<Rules> rules;
+  DiagnosticBuffer diagnostics;
+
+  for (const Generator::File &file: generator.files())
+    std::ofstream(std::string(directory) + "/" + file.name) << file.content;
+  std::ofstream(rulesPath) << generator.rules();
+
+  try {
+    auto none = []() {};
+
+    run(single, "read_construct", [&]() { makefile.reset(); }, [&]() { makefile = std::make_unique<Makefile>(root); });
+    run(single, "construct", [&]() { makefile.reset(); }, [&]() { makefile = std::make_unique<Makefile>(root, std::string(generator.makefile())); });
+    run(single, "clean", none, [&]() { MakefileBench::clean(*makefile); });
+    run(single, "extract_variables", [&]() { MakefileBench::resetVariables(*makefile); }, [&]() { MakefileBench::extractVariables(*makefile); });
+    run(single, "extract_receipes", [&]() { MakefileBench::resetReceipes(*makefile); }, [&]() { MakefileBench::extractReceipes(*makefile); });
+    run(single, "extract_phony", [&]() {
+      MakefileBench::resetReceipes(*makefile);
+      MakefileBench::extractReceipes(*makefile);
+    }, [&]() { MakefileBench::extractPhony(*makefile); });
+    makefile = std::make_unique<Makefile>(root);
+    if (options.includes > 0)
+      run(total, "resolve_includes", [&]() { includes = std::make_unique<IncludeCache>(); }, [&]() { makefile->resolveIncludes(*includes); });
+    run(total, "rules_load_cold", [&]() {
+      rules.reset();
+      removeFiles(cacheDirectory);
+    }, [&]() { rules = std::make_unique<Rules>(rulesPath, false, cacheDirectory); });
+    run(total, "rules_load_warm", [&]() { rules.reset(); }, [&]() { rules = std::make_unique<Rules>(rulesPath, false, cacheDirectory); });
+
+    CountingSink counts;
+
+    rules->check(*makefile, counts);
+    if (counts.forbidden != 0 || counts.missing != generator.missing())
+      throw std::runtime_error("generated rules report " + std::to_string(counts.forbidden) + " forbidden and " + std::to_string(counts.missing) +
+                               " missing, expected 0 and " + std::to_string(generator.missing()));
+    run(total, "rules_check", [&]() { diagnostics = DiagnosticBuffer(); }, [&]() { rules->check(*makefile, diagnostics); });
+  }
+  catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+  makefile.reset();
+  rules.reset();
+  for (const Generator::File &file: generator.files())
+    unlink((std::string(directory) + "/" + file.name).c_str());
+  unlink(rulesPath.c_str());
+  removeFiles(cacheDirectory);
+  rmdir(cacheDirectory.c_str());
+  rmdir(directory);
+  return 0;
+}
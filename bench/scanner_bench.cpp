@@ -0,0 +1,146 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <list>
+#include "scanner.hpp"
+#include "utils.hpp"
+
+static std::string generate(size_t size)
+{
+  std::string out;
+  size_t n = 0;
+
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    std::string id = std::to_string(n++);
+
+    switch (n % 8) {
+    case 0:
+      out += "# generated section " + id + "\n\n";
+      break;
+    case 1:
+      out += "SRC_" + id + " := $(addprefix ./src/, main_" + id + ".cpp util_" + id + ".cpp) # sources\n";
+      break;
+    case 2:
+      out += "CFLAGS_" + id + " = -W -Wall -Wextra \\\n\t-O2 -g \\\n\t-I include\n";
+      break;
+    case 3:
+      out += "obj/" + id + ".o: src/" + id + ".cpp include/" + id + ".hpp\n";
+      break;
+    case 4:
+      out += "\t$(CXX) $(CXXFLAGS) -c $< -o $@\n";
+      break;
+    case 5:
+      out += "\t@echo built " + id + "\n";
+      break;
+    case 6:
+      out += "LDFLAGS += -L lib/" + id + "\n";
+      break;
+    default:
+      out += ".PHONY: target_" + id + "\n";
+    }
+  }
+  return out;
+}
+
+struct Counts {
+  size_t lines = 0;
+  size_t comments = 0;
+  size_t continuations = 0;
+};
+
+static Counts getlinePath(const std::string &buffer)
+{
+  std::istringstream stream(buffer);
+  std::list<std::string> lines;
+  std::string line;
+  Counts counts;
+
+  while (std::getline(stream, line))
+    lines.push_back(line);
+  for (const std::string &l: lines) {
+    counts.lines++;
+    if (starts_with(l, "#"))
+      counts.comments++;
+    else if (ends_with(l, "\\"))
+      counts.continuations++;
+  }
+  return counts;
+}
+
+static Counts findPath(std::string_view buffer)
+{
+  Counts counts;
+  size_t pos = 0;
+
+  while (pos < buffer.size()) {
+    size_t eol = buffer.find('\n', pos);
+
+    if (eol == std::string_view::npos)
+      eol = buffer.size();
+    std::string_view line = buffer.substr(pos, eol - pos);
+
+    pos = eol + 1;
+    counts.lines++;
+    if (starts_with(line, "#"))
+      counts.comments++;
+    else if (ends_with(line, "\\"))
+      counts.continuations++;
+  }
+  return counts;
+}
+
+static Counts scannerPath(std::string_view buffer, Scanner::Implementation implementation, Scanner::Result &result)
+{
+  Counts counts;
+
+  Scanner::scan(buffer, result, implementation);
+  counts.lines = result.lineEnds.size();
+  for (uint8_t flags: result.flags) {
+    if (flags & Scanner::Comment)
+      counts.comments++;
+    else if (flags & Scanner::Continuation)
+      counts.continuations++;
+  }
+  return counts;
+}
+
+template <typename F>
+static void run(const std::string &name, size_t bytes, F &&f)
+{
+  const int iterations = 5;
+  double best = 0;
+  Counts counts;
+
+  for (int i = 0; i < iterations; i++) {
+    auto begin = std::chrono::steady_clock::now();
+    counts = f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    if (i == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+  std::cout << std::left << std::setw(10) << name
+            << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (bytes / best / 1e6) << " MB/s"
+            << "  lines=" << counts.lines
+            << " comments=" << counts.comments
+            << " continuations=" << counts.continuations << "\n";
+}
+
+int main(int argc, char **argv)
+{
+  size_t size = (argc > 1 ? std::stoul(argv[1]) : 50) * 1024 * 1024;
+  std::string buffer = generate(size);
+  Scanner::Result result;
+
+  std::cout << "synthetic Makefile: " << buffer.size() << " bytes\n";
+  run("getline", buffer.size(), [&]() { return getlinePath(buffer); });
+  run("find", buffer.size(), [&]() { return findPath(buffer); });
+  for (Scanner::Implementation implementation: {Scanner::Scalar, Scanner::Sse2, Scanner::Avx2}) {
+    if (Scanner::isSupported(implementation))
+      run(Scanner::name(implementation), buffer.size(), [&]() { return scannerPath(buffer, implementation, result); });
+  }
+  return 0;
+}
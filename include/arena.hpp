@@ -0,0 +1,25 @@
+#ifndef __ARENA_HPP
+#define __ARENA_HPP
+
+#include <memory_resource>
+#include <unordered_set>
+#include <string_view>
+#include <cstddef>
+
+class Arena {
+public:
+  Arena(size_t initialSize = 4096);
+  Arena(const Arena &other) = delete;
+  ~Arena() = default;
+  Arena &operator=(const Arena &other) = delete;
+  std::pmr::memory_resource *resource();
+  char *allocate(size_t size);
+  std::string_view store(std::string_view str);
+  std::string_view intern(std::string_view str);
+  void release();
+private:
+  std::pmr::monotonic_buffer_resource _resource;
+  std::pmr::unordered_set<std::string_view> _interned;
+};
+
+#endif
@@ -1,14 +1,30 @@
 #ifndef __ARG_HPP
 #define __ARG_HPP
 
+#include <string>
+#include <vector>
+#include "diagnostic.hpp"
+
 class Argument {
 public:
   Argument(char argc, char **argv);
   ~Argument() = default;
   bool isRecursive() const;
   bool isVerbose() const;
+  bool isServing() const;
+  bool isClient() const;
+  bool isStats() const;
+  unsigned int getJobs() const;
+  unsigned int getBranches() const;
+  unsigned int getSlowest() const;
+  DiagnosticSink::Format getFormat() const;
   const std::string &getMakefilePath() const;
   const std::string &getRulesPath() const;
+  const std::vector<std::string> &getSkipDirectories() const;
+  const std::vector<std::string> &getIncludeDirectories() const;
+  const std::string &getCachePath() const;
+  const std::string &getSocketPath() const;
+  const std::string &getTracePath() const;
   bool operator==(bool test) const;
   bool operator!() const;
   //TOTO: make a getRules method;
@@ -17,8 +33,20 @@ private:
   bool _isGood;
   bool _recursive;
   bool _verbose;
+  bool _serve;
+  bool _client;
+  bool _stats;
+  unsigned int _jobs;
+  unsigned int _branches;
+  unsigned int _slowest;
+  DiagnosticSink::Format _format;
   std::string _makefilePath;
   std::string _rulesPath;
+  std::vector<std::string> _skipDirectories;
+  std::vector<std::string> _includeDirectories;
+  std::string _cachePath;
+  std::string _socketPath;
+  std::string _tracePath;
   //TODO: add a Rules object
 };
 
@@ -0,0 +1,113 @@
+#ifndef __DIAGNOSTIC_HPP
+#define __DIAGNOSTIC_HPP
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+struct Diagnostic {
+  enum Kind : uint8_t {
+    MissingRule,
+    MissingVariable,
+    ForbiddenRule,
+    ForbiddenVariable,
+    DependencyCycle,
+    UnreachableTarget,
+    MissingPhony
+  };
+  Kind kind;
+  std::string_view file;
+  uint32_t line;
+  std::string_view subject;
+  std::string_view pattern;
+  static const char *id(Kind kind);
+  std::string message() const;
+};
+
+class DiagnosticSink {
+public:
+  enum Format : uint8_t {
+    Text,
+    JsonLines,
+    Sarif
+  };
+  virtual ~DiagnosticSink() = default;
+  virtual void report(const Diagnostic &diagnostic) = 0;
+  static std::unique_ptr<DiagnosticSink> create(Format format, std::ostream &out);
+  static void begin(Format format, std::ostream &out);
+  static void end(Format format, std::ostream &out);
+};
+
+class TextSink : public DiagnosticSink {
+public:
+  TextSink(std::ostream &out);
+  void report(const Diagnostic &diagnostic) override;
+private:
+  std::ostream &_out;
+};
+
+class JsonLinesSink : public DiagnosticSink {
+public:
+  JsonLinesSink(std::ostream &out);
+  void report(const Diagnostic &diagnostic) override;
+private:
+  std::ostream &_out;
+  std::string _buffer;
+};
+
+class SarifSink : public DiagnosticSink {
+public:
+  SarifSink(std::ostream &out);
+  void report(const Diagnostic &diagnostic) override;
+  static void header(std::ostream &out);
+  static void footer(std::ostream &out);
+private:
+  std::ostream &_out;
+  std::string _buffer;
+  bool _first;
+};
+
+class UniqueSink : public DiagnosticSink {
+public:
+  UniqueSink(DiagnosticSink &sink);
+  void report(const Diagnostic &diagnostic) override;
+  size_t size() const;
+private:
+  DiagnosticSink &_sink;
+  std::unordered_set<std::string> _seen;
+};
+
+class TimedSink : public DiagnosticSink {
+public:
+  TimedSink(DiagnosticSink &sink);
+  void report(const Diagnostic &diagnostic) override;
+private:
+  DiagnosticSink &_sink;
+};
+
+class DiagnosticBuffer : public DiagnosticSink {
+public:
+  DiagnosticBuffer() = default;
+  void report(const Diagnostic &diagnostic) override;
+  void replay(DiagnosticSink &sink) const;
+  void replay(DiagnosticSink &sink, std::string_view file) const;
+  void serialize(std::string &out) const;
+  bool load(const char *data, size_t size);
+  size_t size() const;
+private:
+  struct Entry {
+    Diagnostic::Kind kind;
+    uint32_t line;
+    uint32_t subject;
+    uint32_t pattern;
+  };
+  std::string _file;
+  std::string _strings;
+  std::vector<Entry> _entries;
+};
+
+#endif
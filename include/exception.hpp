@@ -0,0 +1,18 @@
+#ifndef __EXCEPTION_HPP
+#define __EXCEPTION_HPP
+
+#include <string>
+#include <exception>
+
+class MakefileException : public std::exception {
+public:
+  MakefileException(const std::string &what) : _what(what) {}
+  ~MakefileException() = default;
+  const char *what() const noexcept {
+    return this->_what.c_str();
+  }
+private:
+  std::string _what;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __EXPANDER_HPP
+#define __EXPANDER_HPP
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "makefile.hpp"
+
+class Overlay;
+
+class Expander {
+public:
+  Expander(const Makefile &makefile, const Overlay *overlay = nullptr);
+  Expander(const Makefile &makefile, size_t line);
+  Expander(const Expander &other) = delete;
+  ~Expander() = default;
+  Expander &operator=(const Expander &other) = delete;
+  std::string_view value(std::string_view name);
+  std::string expand(std::string_view text);
+  bool isCyclic(std::string_view name) const;
+  void invalidate(std::string_view name);
+  const Makefile::Variable *variable(std::string_view name);
+  static bool references(std::string_view text, const std::function<bool(std::string_view)> &predicate);
+private:
+  enum State : uint8_t {
+    Pending,
+    Expanding,
+    Done
+  };
+  struct Entry {
+    std::string value;
+    uint32_t generation;
+    State state;
+    bool cyclic;
+    std::vector<std::string_view> dependents;
+  };
+  static const uint32_t undefined = UINT32_MAX;
+  static const unsigned maxDepth = 256;
+  std::pair<const std::string_view, Entry> &_entry(std::string_view name);
+  const Makefile::Variable *_variable(std::string_view name);
+  void _validate();
+  void _invalidate(std::vector<std::string_view> &stale);
+  void _prepare(std::string_view name);
+  void _evaluate(std::pair<const std::string_view, Entry> &entry);
+  void _expand(std::string_view text, std::string &out);
+  void _reference(std::string_view reference, std::string &out);
+  void _lookup(std::string_view name, std::string &out);
+  bool _function(std::string_view name, std::string_view args, std::string &out);
+  const Makefile &_makefile;
+  const Overlay *_overlay;
+  size_t _line;
+  Arena _arena;
+  std::unordered_map<std::string_view, Entry> _entries;
+  std::unordered_map<std::string_view, std::pair<bool, Makefile::Variable>> _snapshot;
+  std::vector<std::pair<std::string, std::string>> _locals;
+  std::vector<std::string_view> _evaluating;
+  uint32_t _generation;
+  unsigned _depth;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __GRAPH_HPP
+#define __GRAPH_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "arena.hpp"
+#include "makefile.hpp"
+#include "patterns.hpp"
+#include "view.hpp"
+
+class Graph {
+public:
+  enum Flag : uint8_t {
+    Rule = 1 << 0,
+    Commands = 1 << 1,
+    Phony = 1 << 2,
+    Local = 1 << 3,
+    Implicit = 1 << 4
+  };
+  Graph(const Makefile &makefile);
+  Graph(const Graph &other) = delete;
+  ~Graph() = default;
+  Graph &operator=(const Graph &other) = delete;
+  size_t size() const;
+  size_t edges() const;
+  int find(std::string_view name) const;
+  std::string_view name(uint32_t node) const;
+  uint32_t line(uint32_t node) const;
+  uint8_t flags(uint32_t node) const;
+  Span<uint32_t> prerequisites(uint32_t node) const;
+  Span<uint32_t> dependents(uint32_t node) const;
+  int defaultGoal() const;
+  const Patterns &patterns() const;
+  std::vector<uint32_t> closure(uint32_t root) const;
+  std::vector<uint32_t> unreachable(uint32_t root) const;
+  std::vector<std::vector<uint32_t>> cycles() const;
+  std::vector<uint32_t> missingPhony() const;
+private:
+  uint32_t _intern(std::string_view name);
+  static void _index(size_t nodes, const std::vector<std::pair<uint32_t, uint32_t>> &pairs, bool reverse, std::vector<uint32_t> &offsets, std::vector<uint32_t> &edges);
+  Arena _arena;
+  Patterns _patterns;
+  std::unordered_map<std::string_view, uint32_t> _ids;
+  std::vector<std::string_view> _names;
+  std::vector<uint32_t> _lines;
+  std::vector<uint8_t> _flags;
+  std::vector<uint32_t> _offsets;
+  std::vector<uint32_t> _edges;
+  std::vector<uint32_t> _reverseOffsets;
+  std::vector<uint32_t> _reverse;
+  int _default;
+};
+
+#endif
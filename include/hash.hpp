@@ -0,0 +1,90 @@
+#ifndef __HASH_HPP
+#define __HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace hash {
+
+  static constexpr uint64_t k0 = 0xa0761d6478bd642full;
+  static constexpr uint64_t k1 = 0xe7037ed1a0b428dbull;
+  static constexpr uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+  static constexpr uint64_t k3 = 0x589965cc75374cc3ull;
+
+  inline uint64_t mix(uint64_t a, uint64_t b)
+  {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+  }
+
+  inline uint64_t read8(const uint8_t *p)
+  {
+    uint64_t v;
+
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint64_t read4(const uint8_t *p)
+  {
+    uint32_t v;
+
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+}
+
+inline uint64_t hash64(const void *data, size_t size, uint64_t seed = 0)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint64_t a = 0;
+  uint64_t b = 0;
+
+  seed ^= hash::mix(seed ^ hash::k0, hash::k1);
+  if (size <= 16) {
+    if (size >= 4) {
+      size_t shift = (size >> 3) << 2;
+
+      a = (hash::read4(p) << 32) | hash::read4(p + shift);
+      b = (hash::read4(p + size - 4) << 32) | hash::read4(p + size - 4 - shift);
+    }
+    else if (size > 0) {
+      a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[size >> 1]) << 8) | p[size - 1];
+    }
+  }
+  else {
+    size_t i = size;
+
+    if (i > 48) {
+      uint64_t s1 = seed;
+      uint64_t s2 = seed;
+
+      do {
+        seed = hash::mix(hash::read8(p) ^ hash::k1, hash::read8(p + 8) ^ seed);
+        s1 = hash::mix(hash::read8(p + 16) ^ hash::k2, hash::read8(p + 24) ^ s1);
+        s2 = hash::mix(hash::read8(p + 32) ^ hash::k3, hash::read8(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      seed = hash::mix(hash::read8(p) ^ hash::k1, hash::read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = hash::read8(p + i - 16);
+    b = hash::read8(p + i - 8);
+  }
+  return hash::mix(hash::k1 ^ size, hash::mix(a ^ hash::k1, b ^ seed));
+}
+
+inline uint64_t hash64(std::string_view str, uint64_t seed = 0)
+{
+  return hash64(str.data(), str.size(), seed);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __INCLUDE_CACHE_HPP
+#define __INCLUDE_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "makefile.hpp"
+
+class IncludeCache {
+public:
+  IncludeCache(const std::vector<std::string> &directories = {});
+  IncludeCache(const IncludeCache &other) = delete;
+  ~IncludeCache() = default;
+  IncludeCache &operator=(const IncludeCache &other) = delete;
+  std::vector<std::shared_ptr<const Makefile>> resolve(const Makefile &makefile, std::vector<std::string> &dependencies);
+  bool invalidate(const std::string &path);
+  uint64_t fingerprint() const;
+  static bool mentions(std::string_view content);
+private:
+  struct Slot {
+    std::once_flag once;
+    std::shared_ptr<const Makefile> makefile;
+  };
+  std::shared_ptr<Slot> _get(const std::string &path);
+  void _find(const Makefile &makefile, std::vector<std::string> &paths, std::vector<std::string> &dependencies) const;
+  std::string _locate(std::string_view name, const std::string &directory, std::vector<std::string> &dependencies) const;
+  std::vector<std::string> _directories;
+  std::mutex _mutex;
+  std::unordered_map<std::string, std::shared_ptr<Slot>> _slots;
+};
+
+#endif
@@ -2,53 +2,190 @@
 #define __MAKEFILE_HPP_
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <iostream>
 #include <algorithm>
-#include <fstream>
 #include <exception>
 #include <map>
-#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "arena.hpp"
+#include "exception.hpp"
+#include "mapped_file.hpp"
 #include "utils.hpp"
+#include "view.hpp"
 
-class MakefileException : public std::exception {
-public:
-  MakefileException(const std::string &what) : _what(what) {}
-  ~MakefileException() = default;
-  const char *what() const noexcept {
-    return this->_what.c_str();
-  }
-private:
-  std::string _what;
-};
+class Expander;
+class IncludeCache;
 
 class Makefile {
 public:
-  Makefile(const std::string &makefilePath, bool verbose = false);
+  Makefile(const std::string &makefilePath, bool verbose = false, std::ostream &out = std::cout);
+  Makefile(const std::string &makefilePath, MappedFile &&file, bool verbose = false, std::ostream &out = std::cout);
+  Makefile(const std::string &makefilePath, std::string &&content, bool verbose = false, std::ostream &out = std::cout);
+  Makefile(const Makefile &other) = delete;
   ~Makefile() = default;
+  Makefile &operator=(const Makefile &other) = delete;
+  struct Receipe {
+    std::string_view target;
+    std::string_view pattern;
+    std::string_view deps;
+    uint32_t firstCmd;
+    uint32_t cmdCount;
+    uint32_t line;
+    Words targets() const { return Words(this->target); }
+    Words prerequisites() const { return Words(this->deps); }
+    bool isPattern() const { return this->pattern.empty() && this->target.find('%') != std::string_view::npos; }
+  };
+  struct Variable {
+    enum Flavor : uint8_t {
+      Recursive,
+      Simple,
+      Shell
+    };
+    std::string_view value;
+    uint32_t line;
+    Flavor flavor;
+    uint32_t generation;
+  };
+  struct Scope {
+    std::string_view target;
+    std::string_view name;
+    std::string_view value;
+    uint32_t line;
+    char op;
+    Words targets() const { return Words(this->target); }
+  };
+  struct Include {
+    std::string_view path;
+    uint32_t line;
+    bool optional;
+  };
+  using Variables = std::pmr::map<std::string_view, Variable>;
+  const std::string &getPath() const;
+  bool variableAt(std::string_view name, size_t line, Variable &variable, Arena &arena) const;
+  void edit(size_t offset, size_t length, std::string_view replacement);
+  void update(std::string_view content);
+  Span<Receipe> receipes() const;
+  Span<std::string_view> commands(const Receipe &receipe) const;
+  const Variables &variables() const;
+  Span<Scope> scopes() const;
+  uint32_t generation() const;
+  Words phony() const;
+  std::vector<Include> includes() const;
+  void resolveIncludes(IncludeCache &cache);
+  const std::vector<std::shared_ptr<const Makefile>> &included() const;
+  const std::vector<std::string> &dependencies() const;
+  const std::vector<uint32_t> &branches() const;
+  void select(const std::vector<uint32_t> &arms);
   const std::string getMakefile() const;
   const std::string getVariables() const;
   const std::string getReceipes() const;
+  const std::string getTargetVariables() const;
 private:
-  struct Receipe {
-    std::string target;
-    std::string deps;
-    std::list<std::string> cmds; 
+  friend class MakefileBench;
+  struct Line {
+    enum Kind : uint8_t {
+      Other,
+      Variable,
+      VariableModifier,
+      ReceipeTarget,
+      ReceipeCommand,
+      TargetVariable,
+      Directive
+    };
+    std::string_view text;
+    Kind kind;
+    char op;
+    bool active;
+    bool multiline;
+    uint32_t nameBegin;
+    uint32_t nameEnd;
+    uint32_t valueBegin;
+    uint32_t valueEnd;
+    uint32_t lineno;
+    std::string_view name() const { return this->text.substr(this->nameBegin, this->nameEnd - this->nameBegin); }
+    std::string_view value() const { return this->text.substr(this->valueBegin, this->valueEnd - this->valueBegin); }
+  };
+  struct Site {
+    uint32_t line;
+    std::string_view value;
+  };
+  struct Revision {
+    std::vector<std::string_view> names;
+    std::map<std::string, bool, std::less<>> affected;
+    size_t first;
+    size_t last;
   };
-  bool _isVariable(const std::string &line) const;
-  bool _isVariableModifier(const std::string &line) const;
-  bool _isReceipeTarget(const std::string &line) const;
-  bool _isReceipeCommand(const std::string &line) const;
-  void _cleanMakefile();
+  Line _classifyLine(std::string_view line, size_t comment);
+  bool _isReceipeCommand(std::string_view line) const;
+  bool _isBranch(const Line &line) const;
+  bool _isBranching(const Line &line) const;
+  bool _isEager(const Line &line) const;
+  void _parse(std::string_view content);
+  void _extract();
+  bool _condition(std::string_view directive, std::string_view args, Expander &expander) const;
+  void _dump(std::ostream &out) const;
+  void _cleanMakefile(std::string_view content);
+  bool _cleanLines(size_t first, size_t last, std::pmr::vector<Line> &lines);
+  void _pushLine(std::pmr::vector<Line> &lines, std::string_view line, size_t comment, uint32_t lineno);
+  void _pushDefine(std::pmr::vector<Line> &lines, std::string_view text, size_t header, uint32_t lineno);
+  std::string_view _joinLines(const std::vector<std::string_view> &lines);
+  std::string_view _epur(std::string_view str);
   void _extractVariables();
-  void _extractVariableModifiers();
+  void _extractVariable(std::string_view name);
+  bool _replay(std::string_view name, size_t limit, Variable &variable, Arena &arena) const;
+  std::string_view _siteValue(size_t line) const;
+  size_t _enclosing(size_t line, size_t &depth, size_t &choices) const;
+  size_t _blockEnd(size_t line) const;
+  bool _depends(std::string_view text, Revision &revision) const;
+  void _touch(std::string_view name, Revision &revision) const;
+  void _revise(Site &site, bool force, Revision &revision);
+  size_t _rewalk(size_t start, size_t bound, std::vector<uint32_t> &branches, Revision &revision);
+  void _propagate(size_t position, Revision &revision, std::vector<std::pair<size_t, size_t>> &dirty);
+  void _recollect(size_t first, size_t last, uint32_t from);
   void _extractReceipes();
+  void _collectReceipes(size_t first, size_t last, std::pmr::vector<Receipe> &receipes, std::pmr::vector<std::string_view> &cmds);
   void _extractPhony();
+  void _collectScopes(size_t first, size_t last, std::pmr::vector<Scope> &scopes);
+  void _joinPhony();
+  std::string_view _variableName(const Line &line);
+  void _indexLines();
+  size_t _lineAt(size_t offset) const;
+  size_t _logicalAt(size_t line) const;
+  std::string _text() const;
+  void _rebuild(std::string &&content);
   std::string _makefilePath;
   bool _verbose;
-  std::map<std::string, std::string> _variables;
-  std::list<Receipe> _receipes;
-  std::list<std::string> _makefile;
-  std::string _phony;
+  MappedFile _file;
+  std::string _content;
+  Arena _arena;
+  Variables _variables;
+  std::pmr::vector<Receipe> _receipes;
+  std::pmr::vector<std::string_view> _cmds;
+  std::pmr::vector<Line> _makefile;
+  std::pmr::vector<Receipe> _phonies;
+  std::pmr::vector<Scope> _scopes;
+  size_t _counts[Line::Directive + 1];
+  char _recipePrefix;
+  size_t _recipePrefixes;
+  size_t _conditionals;
+  size_t _expansions;
+  std::vector<uint32_t> _branches;
+  std::vector<uint32_t> _forced;
+  uint32_t _generation;
+  std::string_view _phony;
+  std::vector<std::string_view> _lines;
+  std::vector<size_t> _offsets;
+  std::unordered_map<std::string_view, std::vector<uint32_t>> _occurrences;
+  std::vector<Site> _sites;
+  size_t _size;
+  size_t _edited;
+  bool _indexed;
+  std::vector<std::shared_ptr<const Makefile>> _included;
+  std::vector<std::string> _dependencies;
 };
 
 #endif
@@ -0,0 +1,25 @@
+#ifndef __MAPPED_FILE_HPP
+#define __MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include "exception.hpp"
+
+class MappedFile {
+public:
+  MappedFile();
+  MappedFile(const std::string &path);
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &other) = delete;
+  ~MappedFile();
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile &operator=(const MappedFile &other) = delete;
+  std::string_view view() const;
+  const char *data() const;
+  size_t size() const;
+private:
+  const char *_data;
+  size_t _size;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __MATCHER_HPP
+#define __MATCHER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "view.hpp"
+
+class Matcher {
+public:
+  Matcher() = default;
+  Matcher(const Matcher &other) = delete;
+  ~Matcher() = default;
+  Matcher &operator=(const Matcher &other) = delete;
+  void add(std::string_view pattern);
+  void compile();
+  void serialize(std::string &out) const;
+  size_t load(const char *data, size_t size);
+  size_t size() const;
+  std::string_view pattern(uint32_t index) const;
+  int find(std::string_view name) const;
+  template <typename F>
+  void forEachMatch(std::string_view name, F &&callback) const;
+  static bool isGlob(std::string_view pattern);
+  static bool glob(std::string_view pattern, std::string_view name);
+private:
+  struct Pattern {
+    uint32_t offset;
+    uint32_t size;
+  };
+  struct Slot {
+    uint32_t hash;
+    uint32_t pattern;
+  };
+  struct Node {
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t pattern;
+    uint32_t c;
+  };
+  static constexpr uint32_t none = UINT32_MAX;
+  uint32_t _exactFind(std::string_view name) const;
+  uint32_t _child(Span<Node> trie, uint32_t node, char c) const;
+  void _insert(std::vector<Node> &trie, std::string_view key, bool reversed, uint32_t pattern);
+  void _bind();
+  std::string _strings;
+  std::vector<Pattern> _patterns;
+  std::vector<Slot> _exact;
+  std::vector<Node> _prefix;
+  std::vector<Node> _suffix;
+  std::vector<uint32_t> _globs;
+  Span<char> _stringsView;
+  Span<Pattern> _patternsView;
+  Span<Slot> _exactView;
+  Span<Node> _prefixView;
+  Span<Node> _suffixView;
+  Span<uint32_t> _globsView;
+};
+
+template <typename F>
+void Matcher::forEachMatch(std::string_view name, F &&callback) const
+{
+  uint32_t found = this->_exactFind(name);
+
+  if (found != none)
+    callback(found);
+  for (uint32_t node = 0, i = 0; node != none && !this->_prefixView.empty(); i++) {
+    if (this->_prefixView[node].pattern != none)
+      callback(this->_prefixView[node].pattern);
+    node = (i < name.size() ? this->_child(this->_prefixView, node, name[i]) : none);
+  }
+  for (uint32_t node = 0, i = 0; node != none && !this->_suffixView.empty(); i++) {
+    if (this->_suffixView[node].pattern != none)
+      callback(this->_suffixView[node].pattern);
+    node = (i < name.size() ? this->_child(this->_suffixView, node, name[name.size() - 1 - i]) : none);
+  }
+  for (uint32_t pattern: this->_globsView) {
+    if (Matcher::glob(this->pattern(pattern), name))
+      callback(pattern);
+  }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __ORDERED_OUTPUT_HPP
+#define __ORDERED_OUTPUT_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class OrderedOutput {
+public:
+  OrderedOutput(size_t count, std::string_view separator);
+  OrderedOutput(const OrderedOutput &other) = delete;
+  ~OrderedOutput();
+  OrderedOutput &operator=(const OrderedOutput &other) = delete;
+  void wait(size_t index);
+  void complete(size_t index, std::string &&out, std::string &&err);
+  void flush();
+  static const size_t flushThreshold = 1 << 20;
+  static const size_t heldLimit = 1 << 26;
+private:
+  struct Slot {
+    std::string out;
+    std::string err;
+    bool done;
+  };
+  void _flush();
+  std::mutex _mutex;
+  std::condition_variable _merged;
+  std::vector<Slot> _slots;
+  size_t _next;
+  size_t _held;
+  std::string _separator;
+  bool _written;
+  std::string _out;
+  std::string _err;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __OVERLAY_HPP
+#define __OVERLAY_HPP
+
+#include <map>
+#include <string_view>
+#include "arena.hpp"
+#include "makefile.hpp"
+
+class Overlay {
+public:
+  Overlay(const Makefile &makefile, std::string_view target);
+  Overlay(const Overlay &other) = delete;
+  ~Overlay() = default;
+  Overlay &operator=(const Overlay &other) = delete;
+  size_t size() const;
+  std::string_view target() const;
+  const std::map<std::string_view, Makefile::Variable> &variables() const;
+  const Makefile::Variable *find(std::string_view name) const;
+  const Makefile::Variable *lookup(std::string_view name) const;
+private:
+  void _apply(const Makefile::Scope &scope);
+  const Makefile &_makefile;
+  Arena _arena;
+  std::string_view _target;
+  std::map<std::string_view, Makefile::Variable> _layer;
+};
+
+#endif
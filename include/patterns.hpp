@@ -0,0 +1,49 @@
+#ifndef __PATTERNS_HPP
+#define __PATTERNS_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arena.hpp"
+#include "makefile.hpp"
+
+class Patterns {
+public:
+  struct Rule {
+    std::string_view target;
+    std::string_view prefix;
+    std::string_view suffix;
+    const Makefile::Receipe *receipe;
+    uint32_t order;
+    bool local;
+  };
+  Patterns(const Makefile &makefile);
+  Patterns(const Patterns &other) = delete;
+  ~Patterns() = default;
+  Patterns &operator=(const Patterns &other) = delete;
+  size_t size() const;
+  const Rule *find(std::string_view name, std::string &stem) const;
+  static bool match(std::string_view pattern, std::string_view name, std::string_view &stem);
+  static std::string substitute(std::string_view pattern, std::string_view stem);
+private:
+  struct Shape {
+    uint32_t prefix;
+    uint32_t suffix;
+    bool local;
+  };
+  struct Slot {
+    uint32_t hash;
+    uint32_t rule;
+  };
+  static constexpr uint32_t none = UINT32_MAX;
+  static bool _before(const Shape &a, const Shape &b);
+  static uint32_t _hash(std::string_view prefix, std::string_view suffix, bool local);
+  uint32_t _find(std::string_view prefix, std::string_view suffix, bool local) const;
+  Arena _arena;
+  std::vector<Rule> _rules;
+  std::vector<Shape> _shapes;
+  std::vector<Slot> _index;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __RESULT_CACHE_HPP
+#define __RESULT_CACHE_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "diagnostic.hpp"
+#include "mapped_file.hpp"
+#include "view.hpp"
+
+class ResultCache {
+public:
+  ResultCache(const std::string &directory, uint64_t fingerprint);
+  ResultCache(const ResultCache &other) = delete;
+  ~ResultCache() = default;
+  ResultCache &operator=(const ResultCache &other) = delete;
+  uint64_t key(std::string_view content) const;
+  uint64_t key(uint64_t key, uint64_t dependencies) const;
+  bool lookup(uint64_t key, DiagnosticBuffer &diagnostics) const;
+  bool lookup(uint64_t key, std::vector<std::string> &dependencies) const;
+  void store(uint64_t key, const DiagnosticBuffer &diagnostics);
+  void store(uint64_t key, const std::vector<std::string> &dependencies);
+  void flush();
+  static uint64_t signature(const std::vector<std::string> &paths);
+private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fingerprint;
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t dataSize;
+    uint64_t generation;
+  };
+  struct Slot {
+    uint64_t key;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t generation;
+  };
+  bool _find(uint64_t key, std::string_view &record) const;
+  void _store(uint64_t key, std::string &&record);
+  bool _map();
+  std::string _directory;
+  std::string _indexPath;
+  std::string _dataPath;
+  std::string _lockPath;
+  uint64_t _fingerprint;
+  MappedFile _index;
+  MappedFile _data;
+  Span<Slot> _slots;
+  uint64_t _generation;
+  mutable std::mutex _mutex;
+  std::vector<std::pair<uint64_t, std::string>> _pending;
+  std::unordered_set<uint64_t> _pendingKeys;
+  mutable std::unordered_set<uint64_t> _touched;
+};
+
+#endif
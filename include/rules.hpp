@@ -1,21 +1,52 @@
 #ifndef __RULES_HPP
 #define __RULES_HPP
 
+#include <sys/stat.h>
 #include <iomanip>
+#include <fstream>
+#include <memory>
+#include "diagnostic.hpp"
+#include "expander.hpp"
+#include "graph.hpp"
 #include "makefile.hpp"
+#include "mapped_file.hpp"
+#include "matcher.hpp"
 #include "json.hpp"
 
 using json = nlohmann::json;
 
 class Rules {
 public:
-  Rules(const std::string &path, bool verbose = false);
+  Rules(const std::string &path, bool verbose = false, const std::string &cacheDirectory = "");
   ~Rules();
-  int check(const Makefile &makefile);
+  int check(const Makefile &makefile, DiagnosticSink &sink) const;
+  int checkRules(const Makefile &makefile, DiagnosticSink &sink) const;
+  int checkVariables(const Makefile &makefile, DiagnosticSink &sink) const;
+  int checkGraph(const Makefile &makefile, DiagnosticSink &sink) const;
+  uint64_t fingerprint() const;
 private:
+  enum GraphCheck : uint32_t {
+    CycleCheck = 1 << 0,
+    UnreachableCheck = 1 << 1,
+    PhonyCheck = 1 << 2
+  };
+  struct Section {
+    Matcher rules;
+    Matcher variables;
+  };
+  void _compile(const json &rules, const std::string &section, const std::string &key, Matcher &matcher) const;
+  void _compileGraph(const json &rules);
+  bool _loadCache(const struct stat &st, const uint64_t *sourceHash);
+  void _saveCache(const struct stat &st, uint64_t sourceHash);
   std::string _path; 
+  std::string _cachePath;
   bool _verbose;
-  json _rules;
+  MappedFile _cache;
+  uint64_t _hash;
+  Section _include;
+  Section _exclude;
+  uint32_t _graphChecks;
+  std::string _root;
 };
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef __SCANNER_HPP
+#define __SCANNER_HPP
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class Scanner {
+public:
+  enum Implementation {
+    Scalar,
+    Sse2,
+    Avx2
+  };
+  enum Flag : uint8_t {
+    Comment = 1 << 0,
+    Continuation = 1 << 1
+  };
+  struct Result {
+    std::vector<size_t> lineEnds;
+    std::vector<uint8_t> flags;
+    std::vector<size_t> hashes;
+    void clear();
+  };
+  static void scan(std::string_view buffer, Result &result);
+  static void scan(std::string_view buffer, Result &result, Implementation implementation);
+  static Implementation best();
+  static bool isSupported(Implementation implementation);
+  static const char *name(Implementation implementation);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __SCHEDULER_HPP
+#define __SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Scheduler {
+public:
+  class TaskGroup {
+  public:
+    TaskGroup() : _pending(0) {}
+    TaskGroup(const TaskGroup &other) = delete;
+    TaskGroup &operator=(const TaskGroup &other) = delete;
+  private:
+    friend class Scheduler;
+    std::atomic<size_t> _pending;
+  };
+
+  Scheduler(unsigned int workers = std::thread::hardware_concurrency());
+  Scheduler(const Scheduler &other) = delete;
+  ~Scheduler();
+  Scheduler &operator=(const Scheduler &other) = delete;
+  void submit(std::function<void()> job);
+  void spawn(TaskGroup &group, std::function<void()> job);
+  void wait();
+  void wait(TaskGroup &group);
+  unsigned int size() const;
+  int currentWorker() const;
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> jobs;
+    std::deque<std::function<void()>> tasks;
+  };
+  void _push(std::function<void()> job, bool task);
+  bool _pop(unsigned int self, std::function<void()> &job, bool task);
+  bool _steal(unsigned int self, std::function<void()> &job, bool task);
+  bool _runOne(int self, bool tasksOnly);
+  void _run(unsigned int self);
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<std::thread> _threads;
+  std::atomic<size_t> _queued;
+  std::atomic<size_t> _tasks;
+  std::atomic<size_t> _pending;
+  std::atomic<unsigned int> _next;
+  std::mutex _sleepMutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  bool _stop;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __SERVER_HPP
+#define __SERVER_HPP
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "diagnostic.hpp"
+#include "include_cache.hpp"
+#include "makefile.hpp"
+#include "rules.hpp"
+
+class Server {
+public:
+  Server(const std::string &socketPath, const std::string &rulesPath, const std::vector<std::string> &includeDirectories, bool verbose = false);
+  Server(const Server &other) = delete;
+  ~Server();
+  Server &operator=(const Server &other) = delete;
+  void run();
+  static int request(const std::string &socketPath, const std::string &makefilePath, std::ostream &out);
+  static std::string defaultSocketPath();
+private:
+  struct Entry {
+    std::unique_ptr<Makefile> makefile;
+    DiagnosticBuffer diagnostics;
+    std::string error;
+  };
+  struct Client {
+    int fd;
+    std::string in;
+    std::string out;
+    bool closed;
+  };
+  void _listen();
+  void _accept();
+  void _read(Client &client);
+  void _write(Client &client);
+  void _handle(Client &client, const std::string &line);
+  void _events();
+  void _watch(const std::string &path);
+  void _load(const std::string &path, Entry &entry);
+  void _check(Entry &entry);
+  void _include(Entry &entry);
+  void _refresh(const std::string &path);
+  void _reloadRules();
+  std::string _socketPath;
+  std::string _rulesPath;
+  bool _verbose;
+  std::unique_ptr<Rules> _rules;
+  IncludeCache _includes;
+  int _socket;
+  int _inotify;
+  int _signal;
+  bool _stop;
+  std::map<int, std::string> _directories;
+  std::unordered_map<std::string, Entry> _entries;
+  std::vector<Client> _clients;
+};
+
+#endif
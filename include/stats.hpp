@@ -0,0 +1,83 @@
+#ifndef __STATS_HPP
+#define __STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class Stats {
+public:
+  enum Phase : uint8_t {
+    Read,
+    Clean,
+    Extract,
+    Includes,
+    Check,
+    Rules,
+    Walk,
+    Output
+  };
+  static const size_t phases = Output + 1;
+  struct Record {
+    std::string path;
+    double wall[phases];
+    double cpu[phases];
+    size_t allocations[phases];
+    size_t bytes;
+    size_t physicalLines;
+    size_t logicalLines;
+    double total() const;
+  };
+  class Timer {
+  public:
+    Timer(Phase phase);
+    Timer(const Timer &other) = delete;
+    ~Timer();
+    Timer &operator=(const Timer &other) = delete;
+  private:
+    Record *_record;
+    Timer *_parent;
+    Phase _phase;
+    bool _traced;
+    std::chrono::steady_clock::time_point _wall;
+    double _cpu;
+    size_t _allocations;
+    double _nestedWall;
+    double _nestedCpu;
+    size_t _nestedAllocations;
+  };
+  class File {
+  public:
+    File(const std::string &path);
+    File(const File &other) = delete;
+    ~File();
+    File &operator=(const File &other) = delete;
+  private:
+    Record _record;
+    Record *_previous;
+    bool _enabled;
+    bool _traced;
+    uint32_t _previousFile;
+    std::chrono::steady_clock::time_point _begin;
+  };
+  class Thread {
+  public:
+    Thread();
+    Thread(const Thread &other) = delete;
+    ~Thread();
+    Thread &operator=(const Thread &other) = delete;
+  private:
+    Record _record;
+    bool _enabled;
+  };
+  static void enable();
+  static bool enabled();
+  static void bytes(size_t count);
+  static void lines(size_t physical, size_t logical);
+  static size_t allocations();
+  static size_t allocatedBytes();
+  static void report(std::ostream &out, size_t slowest);
+};
+
+#endif
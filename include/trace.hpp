@@ -0,0 +1,21 @@
+#ifndef __TRACE_HPP
+#define __TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+class Trace {
+public:
+  using Clock = std::chrono::steady_clock;
+  static const size_t capacity = 1 << 16;
+  static const uint32_t noFile = UINT32_MAX;
+  static void enable();
+  static bool enabled();
+  static uint32_t enter(const std::string &path);
+  static void leave(uint32_t previous, Clock::time_point begin);
+  static void complete(const char *name, Clock::time_point begin);
+  static void write(const std::string &path);
+};
+
+#endif
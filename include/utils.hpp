@@ -2,19 +2,33 @@
 #define __UTILS_HPP
 
 #include <string>
+#include <string_view>
+#include <algorithm>
 
-inline bool ends_with(const std::string &value, const std::string &ending)
+inline bool ends_with(std::string_view value, std::string_view ending)
 {
   if (ending.size() > value.size())
     return false;
   return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
 }
 
-inline bool starts_with(const std::string &value, const std::string &starting)
+inline bool starts_with(std::string_view value, std::string_view starting)
 {
   if (starting.size() > value.size())
     return false;
-  return (value.find(starting) == 0);
+  return (value.compare(0, starting.size(), starting) == 0);
+}
+
+inline std::string_view trim(std::string_view s)
+{
+  size_t begin = 0;
+  size_t end = s.size();
+
+  while (begin < end && std::isspace(static_cast<unsigned char>(s[begin])))
+    begin++;
+  while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1])))
+    end--;
+  return s.substr(begin, end - begin);
 }
 
 inline void epur(std::string &s)
@@ -31,6 +45,31 @@ inline void epur(std::string &s)
   s.erase(p, s.end());
 }
 
+inline bool isEpured(std::string_view s)
+{
+  for (size_t i = 0; i < s.size(); i++) {
+    if (std::isspace(static_cast<unsigned char>(s[i])) &&
+        (s[i] != ' ' || i == 0 || i + 1 == s.size() || s[i + 1] == ' '))
+      return false;
+  }
+  return true;
+}
+
+inline size_t epur(std::string_view s, char *out)
+{
+  bool space = false;
+  char *p = out;
+
+  for (auto ch : s)
+    if (std::isspace(static_cast<unsigned char>(ch))) {
+      space = p != out;
+    } else {
+      if (space) *p++ = ' ';
+      *p++ = ch;
+      space = false; }
+  return p - out;
+}
+
 template <typename C, typename T>
 void erase(C &container, T &it)
 {
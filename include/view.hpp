@@ -0,0 +1,68 @@
+#ifndef __VIEW_HPP
+#define __VIEW_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+template <typename T>
+class Span {
+public:
+  Span() : _data(nullptr), _size(0) {}
+  Span(const T *data, size_t size) : _data(data), _size(size) {}
+  const T *begin() const { return this->_data; }
+  const T *end() const { return this->_data + this->_size; }
+  size_t size() const { return this->_size; }
+  bool empty() const { return this->_size == 0; }
+  const T &operator[](size_t index) const { return this->_data[index]; }
+private:
+  const T *_data;
+  size_t _size;
+};
+
+class Words {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view *;
+    using reference = const std::string_view &;
+
+    iterator(std::string_view rest) : _rest(rest) { this->_advance(); }
+    reference operator*() const { return this->_word; }
+    pointer operator->() const { return &this->_word; }
+    iterator &operator++() { this->_advance(); return *this; }
+    iterator operator++(int) { iterator tmp = *this; this->_advance(); return tmp; }
+    bool operator==(const iterator &other) const { return this->_word.data() == other._word.data() && this->_word.size() == other._word.size(); }
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+  private:
+    void _advance() {
+      size_t begin = 0;
+      size_t end;
+
+      while (begin < this->_rest.size() && std::isspace(static_cast<unsigned char>(this->_rest[begin])))
+        begin++;
+      end = begin;
+      while (end < this->_rest.size() && !std::isspace(static_cast<unsigned char>(this->_rest[end])))
+        end++;
+      this->_word = this->_rest.substr(begin, end - begin);
+      if (this->_word.empty())
+        this->_word = std::string_view();
+      this->_rest.remove_prefix(end);
+    }
+    std::string_view _rest;
+    std::string_view _word;
+  };
+
+  Words(std::string_view str) : _str(str) {}
+  iterator begin() const { return iterator(this->_str); }
+  iterator end() const { return iterator(std::string_view()); }
+  bool empty() const { return this->begin() == this->end(); }
+private:
+  std::string_view _str;
+};
+
+#endif
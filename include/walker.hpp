@@ -0,0 +1,25 @@
+#ifndef __WALKER_HPP
+#define __WALKER_HPP
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "scheduler.hpp"
+
+class Walker {
+public:
+  Walker(const std::vector<std::string> &skipDirectories);
+  ~Walker() = default;
+  std::vector<std::string> discover(const std::string &root, Scheduler &pool);
+  static bool isMakefile(std::string_view name);
+  static std::string root(const std::string &path);
+private:
+  void _walk(const std::string &directory, Scheduler &pool);
+  bool _isSkipped(std::string_view name) const;
+  std::vector<std::string> _skipDirectories;
+  std::mutex _mutex;
+  std::vector<std::string> _found;
+};
+
+#endif
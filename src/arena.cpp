@@ -0,0 +1,41 @@
+#include <cstring>
+#include "arena.hpp"
+
+Arena::Arena(size_t initialSize) : _resource(initialSize), _interned(&_resource)
+{}
+
+std::pmr::memory_resource *Arena::resource()
+{
+  return &this->_resource;
+}
+
+char *Arena::allocate(size_t size)
+{
+  return static_cast<char *>(this->_resource.allocate(size, 1));
+}
+
+std::string_view Arena::store(std::string_view str)
+{
+  char *data;
+
+  if (str.empty())
+    return std::string_view();
+  data = this->allocate(str.size());
+  std::memcpy(data, str.data(), str.size());
+  return std::string_view(data, str.size());
+}
+
+std::string_view Arena::intern(std::string_view str)
+{
+  auto found = this->_interned.find(str);
+
+  if (found != this->_interned.end())
+    return *found;
+  return *this->_interned.insert(this->store(str)).first;
+}
+
+void Arena::release()
+{
+  std::pmr::unordered_set<std::string_view>(&this->_resource).swap(this->_interned);
+  this->_resource.release();
+}
@@ -1,20 +1,53 @@
 #include <getopt.h>
+#include <cstdlib>
 #include <string>
+#include <thread>
 #include <iostream>
 #include "argument.hpp"
+#include "server.hpp"
+
+enum LongOption {
+  ServeOption = 256,
+  ClientOption,
+  SocketOption,
+  BranchesOption,
+  StatsOption,
+  TraceOption,
+  FormatOption
+};
 
 static const option long_opts[] = {
   {"makefile", required_argument, nullptr, 'm'},
   {"rules", required_argument, nullptr, 'r'},
   {"recursive", no_argument, nullptr, 'R'},
+  {"skip", required_argument, nullptr, 's'},
+  {"include-dir", required_argument, nullptr, 'I'},
+  {"jobs", required_argument, nullptr, 'j'},
+  {"cache", required_argument, nullptr, 'c'},
+  {"serve", no_argument, nullptr, ServeOption},
+  {"client", no_argument, nullptr, ClientOption},
+  {"socket", required_argument, nullptr, SocketOption},
+  {"branches", required_argument, nullptr, BranchesOption},
+  {"stats", optional_argument, nullptr, StatsOption},
+  {"trace", required_argument, nullptr, TraceOption},
+  {"format", required_argument, nullptr, FormatOption},
   {"verbose", no_argument, nullptr, 'v'},
   {"help", no_argument, nullptr, 'h'},
   {nullptr, no_argument, nullptr, 0}
 };
 
-static const char *short_opts = "m:r:Rvh";
+static const char *short_opts = "m:r:Rs:I:j:c:vh";
+
+static const unsigned long maxJobs = 1024;
+static const unsigned long maxBranches = 65536;
+static const unsigned long maxSlowest = 65536;
+
+static bool isCount(const char *arg, const char *end)
+{
+  return *arg >= '0' && *arg <= '9' && *end == '\0';
+}
 
-Argument::Argument(char argc, char **argv) : _isGood(true), _recursive(false), _verbose(false), _makefilePath("./Makefile"), _rulesPath("./rules.json")
+Argument::Argument(char argc, char **argv) : _isGood(true), _recursive(false), _verbose(false), _serve(false), _client(false), _stats(false), _jobs(std::thread::hardware_concurrency()), _branches(0), _slowest(10), _format(DiagnosticSink::Text), _makefilePath("./Makefile"), _rulesPath("./rules.json"), _skipDirectories({".git", ".hg", ".svn"}), _socketPath(Server::defaultSocketPath())
 {
   int opt;
   
@@ -29,15 +62,98 @@ Argument::Argument(char argc, char **argv) : _isGood(true), _recursive(false), _
     case 'R':
       this->_recursive = true;
       break;
+    case 's':
+      this->_skipDirectories.push_back(optarg);
+      break;
+    case 'I':
+      this->_includeDirectories.push_back(optarg);
+      break;
+    case 'c':
+      this->_cachePath = optarg;
+      break;
+    case 'j': {
+      char *end;
+      unsigned long jobs = std::strtoul(optarg, &end, 10);
+
+      if (!isCount(optarg, end) || jobs == 0 || jobs > maxJobs) {
+        std::cerr << argv[0] << ": invalid job count '" << optarg << "'" << std::endl;
+        this->_isGood = false;
+        return;
+      }
+      this->_jobs = jobs;
+      break;
+    }
+    case BranchesOption: {
+      char *end;
+      unsigned long branches = std::strtoul(optarg, &end, 10);
+
+      if (!isCount(optarg, end) || branches > maxBranches) {
+        std::cerr << argv[0] << ": invalid branch bound '" << optarg << "'" << std::endl;
+        this->_isGood = false;
+        return;
+      }
+      this->_branches = branches;
+      break;
+    }
+    case StatsOption: {
+      char *end;
+      unsigned long slowest = (optarg == nullptr ? this->_slowest : std::strtoul(optarg, &end, 10));
+
+      if (optarg != nullptr && (!isCount(optarg, end) || slowest > maxSlowest)) {
+        std::cerr << argv[0] << ": invalid slowest file count '" << optarg << "'" << std::endl;
+        this->_isGood = false;
+        return;
+      }
+      this->_stats = true;
+      this->_slowest = slowest;
+      break;
+    }
+    case TraceOption:
+      this->_tracePath = optarg;
+      break;
+    case FormatOption:
+      if (std::string(optarg) == "text")
+        this->_format = DiagnosticSink::Text;
+      else if (std::string(optarg) == "jsonl")
+        this->_format = DiagnosticSink::JsonLines;
+      else if (std::string(optarg) == "sarif")
+        this->_format = DiagnosticSink::Sarif;
+      else {
+        std::cerr << argv[0] << ": invalid output format '" << optarg << "'" << std::endl;
+        this->_isGood = false;
+        return;
+      }
+      break;
+    case ServeOption:
+      this->_serve = true;
+      break;
+    case ClientOption:
+      this->_client = true;
+      break;
+    case SocketOption:
+      this->_socketPath = optarg;
+      break;
     case 'v':
       this->_verbose = true;
       break;
     case 'h':
     default:
       std::cout << "usage: " << std::endl;
-      std::cout << "\t" << argv[0] << " [-m|--makefile m-path] [-r|--rules r-path] [-v|--verbose] [-R|--recursive]" << std::endl;
+      std::cout << "\t" << argv[0] << " [-m|--makefile m-path] [-r|--rules r-path] [-v|--verbose] [-R|--recursive] [-s|--skip dir]... [-I|--include-dir i-dir]... [-j|--jobs n] [-c|--cache c-path] [--branches b] [--stats[=n]] [--trace t-path] [--format f] [--serve|--client] [--socket s-path]" << std::endl;
       std::cout << "\t\t" << "m-path: path to a makefile (default to \"./Makefile\")" << std::endl;
-      std::cout << "\t\t" << "m-path: path to a RULES config file (default to \"./RULES\")" << std::endl;
+      std::cout << "\t\t" << "r-path: path to a JSON rules file, compiled once and cached under c-path or $XDG_CACHE_HOME/checkmake (default to \"./rules.json\")" << std::endl;
+      std::cout << "\t\t" << "recursive: check every Makefile, makefile, GNUmakefile and *.mk under the m-path directory" << std::endl;
+      std::cout << "\t\t" << "dir: directory name to skip when recursive (default to .git, .hg and .svn)" << std::endl;
+      std::cout << "\t\t" << "i-dir: directory searched for included makefiles after the including file's own directory" << std::endl;
+      std::cout << "\t\t" << "n: number of worker threads when recursive, from 1 to 1024 (default to the hardware concurrency)" << std::endl;
+      std::cout << "\t\t" << "c-path: directory where results and compiled rules are cached across runs (default to no result cache, and compiled rules in $XDG_CACHE_HOME/checkmake)" << std::endl;
+      std::cout << "\t\t" << "b: check up to b combinations of conditional branches instead of the evaluated ones, from 0 to 65536 (default to 0)" << std::endl;
+      std::cout << "\t\t" << "stats: print per-phase time, I/O, line, memory and allocation statistics to stderr, with the n slowest files, from 0 to 65536 (default to 10)" << std::endl;
+      std::cout << "\t\t" << "t-path: file where a Chrome trace-event timeline of the run is written" << std::endl;
+      std::cout << "\t\t" << "f: diagnostic output format, one of text, jsonl or sarif (default to text, -v, --serve and --client always use text)" << std::endl;
+      std::cout << "\t\t" << "serve: keep parsed makefiles and rules in memory and answer checks on s-path, re-parsing files as they change" << std::endl;
+      std::cout << "\t\t" << "client: ask the server listening on s-path to check m-path" << std::endl;
+      std::cout << "\t\t" << "s-path: unix socket of the server (default to $XDG_RUNTIME_DIR/checkmake.sock)" << std::endl;
       this->_isGood = false;
     }
   }
@@ -53,6 +169,41 @@ bool Argument::isVerbose() const
   return this->_verbose;
 }
 
+bool Argument::isServing() const
+{
+  return this->_serve;
+}
+
+bool Argument::isClient() const
+{
+  return this->_client;
+}
+
+bool Argument::isStats() const
+{
+  return this->_stats;
+}
+
+unsigned int Argument::getJobs() const
+{
+  return (this->_jobs == 0 ? 1 : this->_jobs);
+}
+
+unsigned int Argument::getBranches() const
+{
+  return this->_branches;
+}
+
+unsigned int Argument::getSlowest() const
+{
+  return this->_slowest;
+}
+
+DiagnosticSink::Format Argument::getFormat() const
+{
+  return this->_format;
+}
+
 const std::string &Argument::getMakefilePath() const
 {
   return this->_makefilePath;
@@ -63,6 +214,31 @@ const std::string &Argument::getRulesPath() const
   return this->_rulesPath;
 }
 
+const std::vector<std::string> &Argument::getSkipDirectories() const
+{
+  return this->_skipDirectories;
+}
+
+const std::vector<std::string> &Argument::getIncludeDirectories() const
+{
+  return this->_includeDirectories;
+}
+
+const std::string &Argument::getCachePath() const
+{
+  return this->_cachePath;
+}
+
+const std::string &Argument::getSocketPath() const
+{
+  return this->_socketPath;
+}
+
+const std::string &Argument::getTracePath() const
+{
+  return this->_tracePath;
+}
+
 bool Argument::operator==(bool test) const
 {
   return this->_isGood == test;
@@ -0,0 +1,318 @@
+#include <cctype>
+#include <cstring>
+#include "diagnostic.hpp"
+#include "stats.hpp"
+
+const char *Diagnostic::id(Kind kind)
+{
+  switch (kind) {
+  case MissingRule:
+    return "missing-rule";
+  case MissingVariable:
+    return "missing-variable";
+  case ForbiddenRule:
+    return "forbidden-rule";
+  case ForbiddenVariable:
+    return "forbidden-variable";
+  case DependencyCycle:
+    return "dependency-cycle";
+  case UnreachableTarget:
+    return "unreachable-target";
+  case MissingPhony:
+    return "missing-phony";
+  }
+  return "unknown";
+}
+
+std::string Diagnostic::message() const
+{
+  std::string out;
+
+  switch (this->kind) {
+  case MissingRule:
+    out = "no rule matches required pattern '";
+    out += this->pattern;
+    out += "'";
+    break;
+  case MissingVariable:
+    out = "no variable matches required pattern '";
+    out += this->pattern;
+    out += "'";
+    break;
+  case ForbiddenRule:
+    out = "rule '";
+    out += this->subject;
+    out += "' matches excluded pattern '";
+    out += this->pattern;
+    out += "'";
+    break;
+  case ForbiddenVariable:
+    out = "variable '";
+    out += this->subject;
+    out += "' matches excluded pattern '";
+    out += this->pattern;
+    out += "'";
+    break;
+  case DependencyCycle:
+    if (this->pattern == this->subject) {
+      out = "target '";
+      out += this->subject;
+      out += "' depends on itself";
+    }
+    else {
+      out = "dependency cycle between targets '";
+      out += this->pattern;
+      out += "'";
+    }
+    break;
+  case UnreachableTarget:
+    out = "target '";
+    out += this->subject;
+    out += "' is not reachable from '";
+    out += this->pattern;
+    out += "'";
+    break;
+  case MissingPhony:
+    out = "target '";
+    out += this->subject;
+    out += "' is not declared .PHONY";
+    break;
+  }
+  return out;
+}
+
+static void escape(std::string &out, std::string_view text)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  for (char c: text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 0xf];
+    }
+    else
+      out += c;
+  }
+}
+
+static void escapeUri(std::string &out, std::string_view path)
+{
+  static const char hex[] = "0123456789ABCDEF";
+
+  for (char c: path) {
+    unsigned char byte = static_cast<unsigned char>(c);
+
+    if (std::isalnum(byte) || c == '/' || c == '-' || c == '.' || c == '_' || c == '~')
+      out += c;
+    else {
+      out += '%';
+      out += hex[byte >> 4];
+      out += hex[byte & 0xf];
+    }
+  }
+}
+
+std::unique_ptr<DiagnosticSink> DiagnosticSink::create(Format format, std::ostream &out)
+{
+  switch (format) {
+  case JsonLines:
+    return std::make_unique<JsonLinesSink>(out);
+  case Sarif:
+    return std::make_unique<SarifSink>(out);
+  default:
+    return std::make_unique<TextSink>(out);
+  }
+}
+
+void DiagnosticSink::begin(Format format, std::ostream &out)
+{
+  if (format == Sarif)
+    SarifSink::header(out);
+}
+
+void DiagnosticSink::end(Format format, std::ostream &out)
+{
+  if (format == Sarif)
+    SarifSink::footer(out);
+}
+
+TextSink::TextSink(std::ostream &out) : _out(out)
+{}
+
+void TextSink::report(const Diagnostic &diagnostic)
+{
+  this->_out << diagnostic.file << ":";
+  if (diagnostic.line > 0)
+    this->_out << diagnostic.line << ":";
+  this->_out << " error: " << diagnostic.message() << " [" << Diagnostic::id(diagnostic.kind) << "]\n";
+}
+
+JsonLinesSink::JsonLinesSink(std::ostream &out) : _out(out)
+{}
+
+void JsonLinesSink::report(const Diagnostic &diagnostic)
+{
+  this->_buffer = "{\"file\":\"";
+  escape(this->_buffer, diagnostic.file);
+  this->_buffer += "\",\"line\":";
+  this->_buffer += std::to_string(diagnostic.line);
+  this->_buffer += ",\"rule\":\"";
+  this->_buffer += Diagnostic::id(diagnostic.kind);
+  this->_buffer += "\",\"subject\":\"";
+  escape(this->_buffer, diagnostic.subject);
+  this->_buffer += "\",\"pattern\":\"";
+  escape(this->_buffer, diagnostic.pattern);
+  this->_buffer += "\",\"message\":\"";
+  escape(this->_buffer, diagnostic.message());
+  this->_buffer += "\"}\n";
+  this->_out.write(this->_buffer.data(), this->_buffer.size());
+}
+
+SarifSink::SarifSink(std::ostream &out) : _out(out), _first(true)
+{}
+
+void SarifSink::report(const Diagnostic &diagnostic)
+{
+  this->_buffer = (this->_first ? "" : ",\n");
+  this->_buffer += "{\"ruleId\":\"";
+  this->_buffer += Diagnostic::id(diagnostic.kind);
+  this->_buffer += "\",\"ruleIndex\":";
+  this->_buffer += std::to_string(diagnostic.kind);
+  this->_buffer += ",\"level\":\"error\",\"message\":{\"text\":\"";
+  escape(this->_buffer, diagnostic.message());
+  this->_buffer += "\"},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":\"";
+  escapeUri(this->_buffer, diagnostic.file);
+  this->_buffer += "\"}";
+  if (diagnostic.line > 0) {
+    this->_buffer += ",\"region\":{\"startLine\":";
+    this->_buffer += std::to_string(diagnostic.line);
+    this->_buffer += "}";
+  }
+  this->_buffer += "}}]}";
+  this->_out.write(this->_buffer.data(), this->_buffer.size());
+  this->_first = false;
+}
+
+void SarifSink::header(std::ostream &out)
+{
+  out << "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\",\"runs\":[{\"tool\":{\"driver\":{\"name\":\"checkmake\",\"rules\":[";
+  for (int kind = Diagnostic::MissingRule; kind <= Diagnostic::MissingPhony; kind++)
+    out << (kind == Diagnostic::MissingRule ? "" : ",") << "{\"id\":\"" << Diagnostic::id(static_cast<Diagnostic::Kind>(kind)) << "\"}";
+  out << "]}},\"results\":[\n";
+}
+
+void SarifSink::footer(std::ostream &out)
+{
+  out << "\n]}]}\n";
+}
+
+UniqueSink::UniqueSink(DiagnosticSink &sink) : _sink(sink)
+{}
+
+void UniqueSink::report(const Diagnostic &diagnostic)
+{
+  std::string key(reinterpret_cast<const char *>(&diagnostic.line), sizeof(diagnostic.line));
+
+  key += static_cast<char>(diagnostic.kind);
+  key.append(diagnostic.subject);
+  key += '\0';
+  key.append(diagnostic.pattern);
+  if (this->_seen.insert(std::move(key)).second)
+    this->_sink.report(diagnostic);
+}
+
+size_t UniqueSink::size() const
+{
+  return this->_seen.size();
+}
+
+TimedSink::TimedSink(DiagnosticSink &sink) : _sink(sink)
+{}
+
+void TimedSink::report(const Diagnostic &diagnostic)
+{
+  Stats::Timer timer(Stats::Output);
+
+  this->_sink.report(diagnostic);
+}
+
+void DiagnosticBuffer::report(const Diagnostic &diagnostic)
+{
+  Entry entry = {diagnostic.kind, diagnostic.line, static_cast<uint32_t>(this->_strings.size()), 0};
+
+  if (this->_entries.empty())
+    this->_file = diagnostic.file;
+  this->_strings.append(diagnostic.subject);
+  this->_strings += '\0';
+  entry.pattern = this->_strings.size();
+  this->_strings.append(diagnostic.pattern);
+  this->_strings += '\0';
+  this->_entries.push_back(entry);
+}
+
+void DiagnosticBuffer::replay(DiagnosticSink &sink) const
+{
+  this->replay(sink, this->_file);
+}
+
+void DiagnosticBuffer::replay(DiagnosticSink &sink, std::string_view file) const
+{
+  Stats::Timer timer(Stats::Output);
+
+  for (const Entry &entry: this->_entries) {
+    Diagnostic diagnostic = {entry.kind, file, entry.line,
+                             std::string_view(this->_strings.data() + entry.subject, entry.pattern - entry.subject - 1),
+                             std::string_view(this->_strings.data() + entry.pattern)};
+
+    sink.report(diagnostic);
+  }
+}
+
+void DiagnosticBuffer::serialize(std::string &out) const
+{
+  uint32_t header[2] = {static_cast<uint32_t>(this->_entries.size()), static_cast<uint32_t>(this->_strings.size())};
+
+  out.append(reinterpret_cast<const char *>(header), sizeof(header));
+  for (const Entry &entry: this->_entries) {
+    uint32_t fields[4] = {entry.kind, entry.line, entry.subject, entry.pattern};
+
+    out.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+  }
+  out.append(this->_strings);
+}
+
+bool DiagnosticBuffer::load(const char *data, size_t size)
+{
+  uint32_t header[2];
+  size_t pos = sizeof(header);
+
+  if (size < sizeof(header))
+    return false;
+  std::memcpy(header, data, sizeof(header));
+  if (header[0] > (size - pos) / (4 * sizeof(uint32_t)) || size - pos - header[0] * 4 * sizeof(uint32_t) != header[1])
+    return false;
+  this->_entries.clear();
+  this->_entries.reserve(header[0]);
+  for (uint32_t i = 0; i < header[0]; i++, pos += 4 * sizeof(uint32_t)) {
+    uint32_t fields[4];
+
+    std::memcpy(fields, data + pos, sizeof(fields));
+    if (fields[0] > Diagnostic::MissingPhony || fields[2] >= header[1] || fields[3] >= header[1] || fields[3] <= fields[2])
+      return false;
+    this->_entries.push_back({static_cast<Diagnostic::Kind>(fields[0]), fields[1], fields[2], fields[3]});
+  }
+  this->_strings.assign(data + pos, header[1]);
+  if (!this->_strings.empty() && this->_strings.back() != '\0')
+    return false;
+  return true;
+}
+
+size_t DiagnosticBuffer::size() const
+{
+  return this->_entries.size();
+}
@@ -0,0 +1,694 @@
+#include <algorithm>
+#include <cstdlib>
+#include "expander.hpp"
+#include "overlay.hpp"
+
+static const std::string_view unsupported[] = {
+  "shell", "wildcard", "eval", "file", "info", "warning", "error", "abspath", "realpath", "guile"
+};
+
+static size_t closing(std::string_view text, size_t pos, char open, char close)
+{
+  int depth = 1;
+
+  for (; pos < text.size(); pos++) {
+    if (text[pos] == open)
+      depth++;
+    else if (text[pos] == close && --depth == 0)
+      return pos;
+  }
+  return std::string_view::npos;
+}
+
+static std::vector<std::string_view> split(std::string_view args, size_t count)
+{
+  std::vector<std::string_view> parts;
+  size_t begin = 0;
+  int depth = 0;
+
+  for (size_t pos = 0; pos < args.size(); pos++) {
+    if (args[pos] == '(' || args[pos] == '{')
+      depth++;
+    else if ((args[pos] == ')' || args[pos] == '}') && depth > 0)
+      depth--;
+    else if (args[pos] == ',' && depth == 0 && (count == 0 || parts.size() + 1 < count)) {
+      parts.push_back(args.substr(begin, pos - begin));
+      begin = pos + 1;
+    }
+  }
+  parts.push_back(args.substr(begin));
+  return parts;
+}
+
+static std::string_view nextReference(std::string_view raw, size_t &pos)
+{
+  while ((pos = raw.find('$', pos)) != std::string_view::npos && pos + 1 < raw.size()) {
+    char c = raw[pos + 1];
+    size_t end = pos + 2;
+
+    pos += 2;
+    if (c == '$')
+      continue;
+    if (c != '(' && c != '{')
+      return raw.substr(pos - 1, 1);
+    while (end < raw.size() && raw[end] != ')' && raw[end] != '}' && raw[end] != ':' && raw[end] != '$' && raw[end] != ',' && !std::isspace(static_cast<unsigned char>(raw[end])))
+      end++;
+    if (end < raw.size() && end > pos && (raw[end] == ')' || raw[end] == '}' || raw[end] == ':')) {
+      std::string_view name = raw.substr(pos, end - pos);
+
+      pos = end;
+      return name;
+    }
+  }
+  pos = raw.size();
+  return std::string_view();
+}
+
+static bool matchPattern(std::string_view pattern, std::string_view word, std::string_view &stem)
+{
+  size_t percent = pattern.find('%');
+
+  if (percent == std::string_view::npos) {
+    stem = std::string_view();
+    return pattern == word;
+  }
+  if (word.size() < pattern.size() - 1 || !starts_with(word, pattern.substr(0, percent)) || !ends_with(word, pattern.substr(percent + 1)))
+    return false;
+  stem = word.substr(percent, word.size() - pattern.size() + 1);
+  return true;
+}
+
+static std::string replacePattern(std::string_view replacement, std::string_view stem)
+{
+  size_t percent = replacement.find('%');
+  std::string out(replacement.substr(0, percent));
+
+  if (percent != std::string_view::npos) {
+    out += stem;
+    out += replacement.substr(percent + 1);
+  }
+  return out;
+}
+
+static void appendWord(std::string &out, std::string_view word, bool &first)
+{
+  if (!first)
+    out += ' ';
+  out += word;
+  first = false;
+}
+
+static void patsubst(std::string_view pattern, std::string_view replacement, std::string_view text, std::string &out)
+{
+  std::string_view stem;
+  bool first = true;
+
+  for (std::string_view word: Words(text)) {
+    if (matchPattern(pattern, word, stem))
+      appendWord(out, replacePattern(replacement, stem), first);
+    else
+      appendWord(out, word, first);
+  }
+}
+
+static size_t number(std::string_view text)
+{
+  std::string value(trim(text));
+  char *end;
+  unsigned long n = std::strtoul(value.c_str(), &end, 10);
+
+  return (value.empty() || *end != '\0' ? 0 : n);
+}
+
+Expander::Expander(const Makefile &makefile, const Overlay *overlay) : _makefile(makefile), _overlay(overlay), _line(SIZE_MAX), _generation(makefile.generation()), _depth(0)
+{}
+
+Expander::Expander(const Makefile &makefile, size_t line) : _makefile(makefile), _overlay(nullptr), _line(line), _generation(makefile.generation()), _depth(0)
+{}
+
+std::string_view Expander::value(std::string_view name)
+{
+  auto &entry = this->_entry(name);
+
+  this->_validate();
+  if (entry.second.state != Done)
+    this->_prepare(entry.first);
+  return entry.second.value;
+}
+
+std::string Expander::expand(std::string_view text)
+{
+  std::string out;
+
+  this->_validate();
+  this->_expand(text, out);
+  return out;
+}
+
+bool Expander::isCyclic(std::string_view name) const
+{
+  auto found = this->_entries.find(name);
+
+  return found != this->_entries.end() && found->second.cyclic;
+}
+
+void Expander::invalidate(std::string_view name)
+{
+  std::vector<std::string_view> stale;
+  auto found = this->_entries.find(name);
+
+  this->_generation = this->_makefile.generation();
+  if (found != this->_entries.end())
+    stale.push_back(found->first);
+  this->_invalidate(stale);
+}
+
+const Makefile::Variable *Expander::variable(std::string_view name)
+{
+  return this->_variable(name);
+}
+
+bool Expander::references(std::string_view text, const std::function<bool(std::string_view)> &predicate)
+{
+  for (size_t pos = text.find('$'); pos != std::string_view::npos && pos + 1 < text.size(); pos = text.find('$', pos)) {
+    char open = text[pos + 1];
+    size_t close;
+
+    if (open == '$') {
+      pos += 2;
+      continue;
+    }
+    if (open != '(' && open != '{') {
+      if (predicate(text.substr(pos + 1, 1)))
+        return true;
+      pos += 2;
+      continue;
+    }
+    close = closing(text, pos + 2, open, (open == '(' ? ')' : '}'));
+    std::string_view inner = text.substr(pos + 2, close == std::string_view::npos ? std::string_view::npos : close - pos - 2);
+    size_t end = inner.find_first_of(" \t:$");
+    std::string_view name = inner.substr(0, end);
+
+    if (end != std::string_view::npos && inner[end] == '$')
+      return true;
+    if (end != std::string_view::npos && inner[end] != ':' && (name == "call" || name == "value" || name == "origin" || name == "flavor")) {
+      std::string_view args = inner.substr(end + 1);
+
+      name = trim(args.substr(0, args.find(',')));
+      if (name.find('$') != std::string_view::npos)
+        return true;
+    }
+    if (predicate(name))
+      return true;
+    if (end != std::string_view::npos && references(inner.substr(end + 1), predicate))
+      return true;
+    if (close == std::string_view::npos)
+      break;
+    pos = close + 1;
+  }
+  return false;
+}
+
+std::pair<const std::string_view, Expander::Entry> &Expander::_entry(std::string_view name)
+{
+  auto found = this->_entries.find(name);
+
+  if (found == this->_entries.end())
+    found = this->_entries.emplace(this->_arena.intern(name), Entry{std::string(), 0, Pending, false, {}}).first;
+  return *found;
+}
+
+const Makefile::Variable *Expander::_variable(std::string_view name)
+{
+  if (this->_overlay != nullptr)
+    return this->_overlay->lookup(name);
+  if (this->_line != SIZE_MAX) {
+    auto snapshot = this->_snapshot.find(name);
+
+    if (snapshot == this->_snapshot.end()) {
+      Makefile::Variable variable = {};
+      bool defined = this->_makefile.variableAt(name, this->_line, variable, this->_arena);
+
+      snapshot = this->_snapshot.emplace(this->_arena.intern(name), std::make_pair(defined, variable)).first;
+    }
+    if (snapshot->second.first)
+      return &snapshot->second.second;
+  }
+  else {
+    auto found = this->_makefile.variables().find(name);
+
+    if (found != this->_makefile.variables().end())
+      return &found->second;
+  }
+  for (auto fragment = this->_makefile.included().rbegin(); fragment != this->_makefile.included().rend(); fragment++) {
+    auto found = (*fragment)->variables().find(name);
+
+    if (found != (*fragment)->variables().end())
+      return &found->second;
+  }
+  return nullptr;
+}
+
+void Expander::_validate()
+{
+  std::vector<std::string_view> stale;
+
+  if (this->_makefile.generation() == this->_generation)
+    return;
+  this->_generation = this->_makefile.generation();
+  for (const auto &[name, entry]: this->_entries) {
+    const Makefile::Variable *variable = this->_variable(name);
+
+    if (entry.state == Done && entry.generation != (variable == nullptr ? undefined : variable->generation))
+      stale.push_back(name);
+  }
+  this->_invalidate(stale);
+}
+
+void Expander::_invalidate(std::vector<std::string_view> &stale)
+{
+  while (!stale.empty()) {
+    Entry &entry = this->_entries.at(stale.back());
+    std::vector<std::string_view> dependents = std::move(entry.dependents);
+
+    stale.pop_back();
+    entry.dependents.clear();
+    entry.value.clear();
+    entry.state = Pending;
+    entry.cyclic = false;
+    stale.insert(stale.end(), dependents.begin(), dependents.end());
+  }
+}
+
+void Expander::_prepare(std::string_view name)
+{
+  struct Frame {
+    std::pair<const std::string_view, Entry> *entry;
+    std::string_view raw;
+    size_t pos;
+  };
+  std::vector<Frame> stack;
+  auto push = [this, &stack](std::pair<const std::string_view, Entry> &entry) {
+    const Makefile::Variable *variable = this->_variable(entry.first);
+
+    entry.second.state = Expanding;
+    stack.push_back({&entry, (variable == nullptr || variable->flavor != Makefile::Variable::Recursive ? std::string_view() : variable->value), 0});
+  };
+
+  push(this->_entry(name));
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    std::string_view child = nextReference(frame.raw, frame.pos);
+
+    if (!child.empty()) {
+      auto &entry = this->_entry(child);
+
+      if (entry.second.state == Pending)
+        push(entry);
+      continue;
+    }
+    auto *entry = frame.entry;
+
+    stack.pop_back();
+    this->_evaluate(*entry);
+  }
+}
+
+void Expander::_evaluate(std::pair<const std::string_view, Entry> &entry)
+{
+  const Makefile::Variable *variable = this->_variable(entry.first);
+  std::vector<std::pair<std::string, std::string>> locals;
+
+  entry.second.generation = (variable == nullptr ? undefined : variable->generation);
+  entry.second.value.clear();
+  if (variable != nullptr && variable->flavor == Makefile::Variable::Simple)
+    entry.second.value = variable->value;
+  else if (variable != nullptr && variable->flavor == Makefile::Variable::Recursive) {
+    std::string value;
+
+    locals.swap(this->_locals);
+    this->_evaluating.push_back(entry.first);
+    this->_expand(variable->value, value);
+    this->_evaluating.pop_back();
+    locals.swap(this->_locals);
+    entry.second.value = std::move(value);
+  }
+  entry.second.state = Done;
+}
+
+void Expander::_expand(std::string_view text, std::string &out)
+{
+  size_t pos = 0;
+  size_t found;
+
+  while ((found = text.find('$', pos)) != std::string_view::npos) {
+    out.append(text.substr(pos, found - pos));
+    if (found + 1 >= text.size()) {
+      pos = text.size();
+      break;
+    }
+    char c = text[found + 1];
+
+    if (c == '$') {
+      out += '$';
+      pos = found + 2;
+    }
+    else if (c == '(' || c == '{') {
+      size_t end = closing(text, found + 2, c, (c == '(' ? ')' : '}'));
+
+      if (end == std::string_view::npos) {
+        pos = text.size();
+        break;
+      }
+      this->_reference(text.substr(found + 2, end - found - 2), out);
+      pos = end + 1;
+    }
+    else {
+      this->_lookup(text.substr(found + 1, 1), out);
+      pos = found + 2;
+    }
+  }
+  if (pos < text.size())
+    out.append(text.substr(pos));
+}
+
+void Expander::_reference(std::string_view reference, std::string &out)
+{
+  size_t space = 0;
+  std::string expanded;
+  size_t colon;
+  size_t equal;
+
+  while (space < reference.size() && !std::isspace(static_cast<unsigned char>(reference[space])) && reference[space] != '$')
+    space++;
+  if (space < reference.size() && space > 0 && std::isspace(static_cast<unsigned char>(reference[space]))) {
+    if (this->_function(reference.substr(0, space), trim(reference.substr(space)).empty() ? std::string_view() : reference.substr(reference.find_first_not_of(" \t", space)), out))
+      return;
+  }
+  if (reference.find('$') != std::string_view::npos) {
+    this->_expand(reference, expanded);
+    reference = expanded;
+  }
+  colon = reference.find(':');
+  equal = (colon == std::string_view::npos ? std::string_view::npos : reference.find('=', colon));
+  if (equal == std::string_view::npos) {
+    this->_lookup(reference, out);
+    return;
+  }
+  std::string value;
+  std::string_view from = reference.substr(colon + 1, equal - colon - 1);
+  std::string_view to = reference.substr(equal + 1);
+
+  this->_lookup(reference.substr(0, colon), value);
+  if (from.find('%') != std::string_view::npos)
+    patsubst(from, to, value, out);
+  else {
+    bool first = true;
+
+    for (std::string_view word: Words(value)) {
+      if (ends_with(word, from)) {
+        if (!first)
+          out += ' ';
+        out.append(word.substr(0, word.size() - from.size()));
+        out.append(to);
+        first = false;
+      }
+      else
+        appendWord(out, word, first);
+    }
+  }
+}
+
+void Expander::_lookup(std::string_view name, std::string &out)
+{
+  const Makefile::Variable *variable;
+
+  for (auto it = this->_locals.rbegin(); it != this->_locals.rend(); it++) {
+    if (it->first == name) {
+      out += it->second;
+      return;
+    }
+  }
+  variable = this->_variable(name);
+  auto &entry = this->_entry(name);
+
+  if (!this->_evaluating.empty() && (entry.second.dependents.empty() || entry.second.dependents.back() != this->_evaluating.back()))
+    entry.second.dependents.push_back(this->_evaluating.back());
+  if (variable != nullptr && variable->flavor == Makefile::Variable::Recursive && !this->_locals.empty()) {
+    if (this->_depth >= maxDepth) {
+      entry.second.cyclic = true;
+      return;
+    }
+    this->_depth++;
+    this->_expand(variable->value, out);
+    this->_depth--;
+    return;
+  }
+  if (entry.second.state == Expanding) {
+    if (variable != nullptr && variable->flavor == Makefile::Variable::Recursive) {
+      entry.second.cyclic = true;
+      if (!this->_evaluating.empty())
+        this->_entry(this->_evaluating.back()).second.cyclic = true;
+    }
+    return;
+  }
+  if (entry.second.state != Done) {
+    if (this->_depth >= maxDepth) {
+      entry.second.cyclic = true;
+      return;
+    }
+    this->_depth++;
+    this->_prepare(entry.first);
+    this->_depth--;
+  }
+  out += entry.second.value;
+}
+
+bool Expander::_function(std::string_view name, std::string_view args, std::string &out)
+{
+  auto expanded = [this](std::string_view arg) {
+    std::string value;
+
+    this->_expand(arg, value);
+    return value;
+  };
+  bool first = true;
+
+  if (std::find(std::begin(unsupported), std::end(unsupported), name) != std::end(unsupported))
+    return true;
+  if (name == "subst") {
+    std::vector<std::string_view> parts = split(args, 3);
+
+    if (parts.size() < 3)
+      return true;
+    std::string from = expanded(parts[0]);
+    std::string to = expanded(parts[1]);
+    std::string text = expanded(parts[2]);
+    size_t pos = 0;
+    size_t found;
+
+    if (from.empty()) {
+      out += text;
+      return true;
+    }
+    while ((found = text.find(from, pos)) != std::string::npos) {
+      out.append(text, pos, found - pos);
+      out += to;
+      pos = found + from.size();
+    }
+    out.append(text, pos, std::string::npos);
+  }
+  else if (name == "patsubst") {
+    std::vector<std::string_view> parts = split(args, 3);
+
+    if (parts.size() == 3)
+      patsubst(expanded(parts[0]), expanded(parts[1]), expanded(parts[2]), out);
+  }
+  else if (name == "strip" || name == "sort" || name == "words" || name == "firstword" || name == "lastword") {
+    std::string text = expanded(args);
+    std::vector<std::string_view> words(Words(text).begin(), Words(text).end());
+
+    if (name == "sort") {
+      std::sort(words.begin(), words.end());
+      words.erase(std::unique(words.begin(), words.end()), words.end());
+    }
+    if (name == "words")
+      out += std::to_string(words.size());
+    else if (name == "firstword" || name == "lastword") {
+      if (!words.empty())
+        out += (name == "firstword" ? words.front() : words.back());
+    }
+    else {
+      for (std::string_view word: words)
+        appendWord(out, word, first);
+    }
+  }
+  else if (name == "findstring") {
+    std::vector<std::string_view> parts = split(args, 2);
+
+    if (parts.size() == 2) {
+      std::string find = expanded(parts[0]);
+
+      if (expanded(parts[1]).find(find) != std::string::npos)
+        out += find;
+    }
+  }
+  else if (name == "filter" || name == "filter-out") {
+    std::vector<std::string_view> parts = split(args, 2);
+
+    if (parts.size() < 2)
+      return true;
+    std::string patterns = expanded(parts[0]);
+    std::string text = expanded(parts[1]);
+    std::string_view stem;
+
+    for (std::string_view word: Words(text)) {
+      bool matched = false;
+
+      for (std::string_view pattern: Words(patterns))
+        matched = matched || matchPattern(pattern, word, stem);
+      if (matched == (name == "filter"))
+        appendWord(out, word, first);
+    }
+  }
+  else if (name == "word" || name == "wordlist") {
+    std::vector<std::string_view> parts = split(args, (name == "word" ? 2 : 3));
+
+    if (parts.size() < (name == "word" ? 2u : 3u))
+      return true;
+    size_t begin = number(expanded(parts[0]));
+    size_t end = (name == "word" ? begin : number(expanded(parts[1])));
+    std::string text = expanded(parts.back());
+    size_t index = 0;
+
+    for (std::string_view word: Words(text)) {
+      index++;
+      if (index >= begin && index <= end)
+        appendWord(out, word, first);
+    }
+  }
+  else if (name == "dir" || name == "notdir" || name == "suffix" || name == "basename") {
+    std::string text = expanded(args);
+
+    for (std::string_view word: Words(text)) {
+      size_t slash = word.rfind('/');
+      size_t dot = word.rfind('.');
+      bool hasSuffix = (dot != std::string_view::npos && (slash == std::string_view::npos || dot > slash));
+
+      if (name == "dir")
+        appendWord(out, (slash == std::string_view::npos ? std::string_view("./") : word.substr(0, slash + 1)), first);
+      else if (name == "notdir")
+        appendWord(out, (slash == std::string_view::npos ? word : word.substr(slash + 1)), first);
+      else if (name == "suffix" && hasSuffix)
+        appendWord(out, word.substr(dot), first);
+      else if (name == "basename")
+        appendWord(out, (hasSuffix ? word.substr(0, dot) : word), first);
+    }
+  }
+  else if (name == "addsuffix" || name == "addprefix") {
+    std::vector<std::string_view> parts = split(args, 2);
+
+    if (parts.size() < 2)
+      return true;
+    std::string affix = expanded(parts[0]);
+    std::string text = expanded(parts[1]);
+
+    for (std::string_view word: Words(text))
+      appendWord(out, (name == "addsuffix" ? std::string(word) + affix : affix + std::string(word)), first);
+  }
+  else if (name == "join") {
+    std::vector<std::string_view> parts = split(args, 2);
+
+    if (parts.size() < 2)
+      return true;
+    std::string left = expanded(parts[0]);
+    std::string right = expanded(parts[1]);
+    Words::iterator l = Words(left).begin();
+    Words::iterator r = Words(right).begin();
+
+    for (; l != Words(left).end() || r != Words(right).end();) {
+      std::string word;
+
+      if (l != Words(left).end())
+        word += *l++;
+      if (r != Words(right).end())
+        word += *r++;
+      appendWord(out, word, first);
+    }
+  }
+  else if (name == "if") {
+    std::vector<std::string_view> parts = split(args, 3);
+
+    if (!trim(expanded(parts[0])).empty()) {
+      if (parts.size() > 1)
+        this->_expand(parts[1], out);
+    }
+    else if (parts.size() > 2)
+      this->_expand(parts[2], out);
+  }
+  else if (name == "or" || name == "and") {
+    std::string value;
+
+    for (std::string_view part: split(args, 0)) {
+      value = expanded(part);
+      if (trim(value).empty() == (name == "and")) {
+        if (name == "and")
+          value.clear();
+        break;
+      }
+    }
+    out += value;
+  }
+  else if (name == "foreach") {
+    std::vector<std::string_view> parts = split(args, 3);
+
+    if (parts.size() < 3)
+      return true;
+    std::string variable(trim(expanded(parts[0])));
+    std::string list = expanded(parts[1]);
+
+    this->_locals.emplace_back(variable, std::string());
+    for (std::string_view word: Words(list)) {
+      std::string value;
+
+      this->_locals.back().second = word;
+      this->_expand(parts[2], value);
+      appendWord(out, value, first);
+    }
+    this->_locals.pop_back();
+  }
+  else if (name == "call") {
+    std::vector<std::string_view> parts = split(args, 0);
+    std::string function(trim(expanded(parts[0])));
+    const Makefile::Variable *variable = this->_variable(function);
+    size_t locals = this->_locals.size();
+
+    if (this->_depth >= maxDepth)
+      return true;
+    this->_locals.emplace_back("0", function);
+    for (size_t i = 1; i < parts.size(); i++)
+      this->_locals.emplace_back(std::to_string(i), expanded(parts[i]));
+    this->_depth++;
+    if (variable != nullptr && variable->flavor == Makefile::Variable::Recursive)
+      this->_expand(variable->value, out);
+    else if (variable != nullptr)
+      this->_expand(this->value(function), out);
+    this->_depth--;
+    this->_locals.resize(locals);
+  }
+  else if (name == "value" || name == "origin" || name == "flavor") {
+    std::string variableName(trim(expanded(args)));
+    const Makefile::Variable *variable = this->_variable(variableName);
+    bool local = std::any_of(this->_locals.begin(), this->_locals.end(), [&variableName](const auto &pair) { return pair.first == variableName; });
+
+    if (name == "value" && variable != nullptr)
+      out += variable->value;
+    else if (name == "origin")
+      out += (local ? "automatic" : (variable != nullptr ? "file" : "undefined"));
+    else if (name == "flavor")
+      out += (variable == nullptr ? "undefined" : (variable->flavor == Makefile::Variable::Simple ? "simple" : "recursive"));
+  }
+  else
+    return false;
+  return true;
+}
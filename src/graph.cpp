@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <memory>
+#include "expander.hpp"
+#include "graph.hpp"
+
+static const std::string_view phonyNames[] = {
+  "all", "check", "clean", "debug", "dist", "distclean", "docs", "fclean", "format", "help",
+  "install", "lint", "maintainer-clean", "mostlyclean", "re", "run", "test", "uninstall"
+};
+
+static bool isSpecial(std::string_view name)
+{
+  if (name.size() < 2 || name[0] != '.')
+    return false;
+  return std::all_of(name.begin() + 1, name.end(), [](char c) { return (c >= 'A' && c <= 'Z') || c == '_'; });
+}
+
+Graph::Graph(const Makefile &makefile) : _patterns(makefile), _default(-1)
+{
+  std::unique_ptr<Expander> expander;
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  std::vector<uint32_t> targets;
+  std::string stem;
+  auto expand = [this, &makefile, &expander](std::string_view text) -> std::string_view {
+    if (text.find('$') == std::string_view::npos)
+      return text;
+    if (expander == nullptr)
+      expander = std::make_unique<Expander>(makefile);
+    return this->_arena.store(expander->expand(text));
+  };
+
+  std::vector<const Makefile *> sources = {&makefile};
+
+  for (const std::shared_ptr<const Makefile> &fragment: makefile.included())
+    sources.push_back(fragment.get());
+  this->_ids.reserve(makefile.receipes().size() * 2);
+  this->_names.reserve(makefile.receipes().size() * 2);
+  for (const Makefile *source: sources) {
+    for (const Makefile::Receipe &receipe: source->receipes()) {
+      std::string_view names = expand(receipe.target);
+
+      if (names.find('%') != std::string_view::npos)
+        continue;
+      targets.clear();
+      for (std::string_view name: Words(names)) {
+        if (isSpecial(name))
+          continue;
+        uint32_t node = this->_intern(name);
+
+        this->_flags[node] |= Rule;
+        if (receipe.cmdCount > 0)
+          this->_flags[node] |= Commands;
+        if (source == &makefile && !(this->_flags[node] & Local)) {
+          this->_flags[node] |= Local;
+          this->_lines[node] = receipe.line;
+        }
+        if (this->_default < 0 && name[0] != '.')
+          this->_default = node;
+        targets.push_back(node);
+      }
+      if (targets.empty())
+        continue;
+      std::string_view pattern = expand(receipe.pattern);
+
+      for (std::string_view name: Words(expand(receipe.deps))) {
+        if (name == "|")
+          continue;
+        if (!pattern.empty()) {
+          for (uint32_t target: targets) {
+            std::string_view matched;
+
+            if (Patterns::match(pattern, this->_names[target], matched))
+              pairs.emplace_back(target, this->_intern(Patterns::substitute(name, matched)));
+          }
+          continue;
+        }
+        uint32_t node = this->_intern(name);
+
+        for (uint32_t target: targets)
+          pairs.emplace_back(target, node);
+      }
+    }
+    for (std::string_view name: source->phony())
+      this->_flags[this->_intern(name)] |= Phony;
+  }
+  for (uint32_t node = 0, explicitNodes = this->_names.size(); node < explicitNodes; node++) {
+    if (this->_flags[node] & (Commands | Phony))
+      continue;
+    const Patterns::Rule *rule = this->_patterns.find(this->_names[node], stem);
+
+    if (rule == nullptr)
+      continue;
+    this->_flags[node] |= Implicit;
+    for (std::string_view name: Words(expand(rule->receipe->deps))) {
+      if (name != "|")
+        pairs.emplace_back(node, this->_intern(Patterns::substitute(name, stem)));
+    }
+  }
+  _index(this->_names.size(), pairs, false, this->_offsets, this->_edges);
+  _index(this->_names.size(), pairs, true, this->_reverseOffsets, this->_reverse);
+}
+
+size_t Graph::size() const
+{
+  return this->_names.size();
+}
+
+size_t Graph::edges() const
+{
+  return this->_edges.size();
+}
+
+int Graph::find(std::string_view name) const
+{
+  auto found = this->_ids.find(name);
+
+  return (found == this->_ids.end() ? -1 : static_cast<int>(found->second));
+}
+
+std::string_view Graph::name(uint32_t node) const
+{
+  return this->_names[node];
+}
+
+uint32_t Graph::line(uint32_t node) const
+{
+  return this->_lines[node];
+}
+
+uint8_t Graph::flags(uint32_t node) const
+{
+  return this->_flags[node];
+}
+
+Span<uint32_t> Graph::prerequisites(uint32_t node) const
+{
+  return Span<uint32_t>(this->_edges.data() + this->_offsets[node], this->_offsets[node + 1] - this->_offsets[node]);
+}
+
+Span<uint32_t> Graph::dependents(uint32_t node) const
+{
+  return Span<uint32_t>(this->_reverse.data() + this->_reverseOffsets[node], this->_reverseOffsets[node + 1] - this->_reverseOffsets[node]);
+}
+
+int Graph::defaultGoal() const
+{
+  return this->_default;
+}
+
+const Patterns &Graph::patterns() const
+{
+  return this->_patterns;
+}
+
+std::vector<uint32_t> Graph::closure(uint32_t root) const
+{
+  std::vector<bool> seen(this->_names.size(), false);
+  std::vector<uint32_t> reached = {root};
+
+  seen[root] = true;
+  for (size_t i = 0; i < reached.size(); i++) {
+    for (uint32_t next: this->prerequisites(reached[i])) {
+      if (!seen[next]) {
+        seen[next] = true;
+        reached.push_back(next);
+      }
+    }
+  }
+  return reached;
+}
+
+std::vector<uint32_t> Graph::unreachable(uint32_t root) const
+{
+  std::vector<bool> seen(this->_names.size(), false);
+  std::vector<uint32_t> nodes;
+
+  for (uint32_t node: this->closure(root))
+    seen[node] = true;
+  for (uint32_t node = 0; node < this->_names.size(); node++) {
+    if (!seen[node] && (this->_flags[node] & Rule))
+      nodes.push_back(node);
+  }
+  return nodes;
+}
+
+std::vector<std::vector<uint32_t>> Graph::cycles() const
+{
+  static const uint32_t unvisited = UINT32_MAX;
+  std::vector<uint32_t> index(this->_names.size(), unvisited);
+  std::vector<uint32_t> low(this->_names.size(), 0);
+  std::vector<bool> onStack(this->_names.size(), false);
+  std::vector<uint32_t> stack;
+  std::vector<std::pair<uint32_t, uint32_t>> calls;
+  std::vector<std::vector<uint32_t>> components;
+  uint32_t counter = 0;
+  auto visit = [&](uint32_t node) {
+    index[node] = low[node] = counter++;
+    stack.push_back(node);
+    onStack[node] = true;
+    calls.emplace_back(node, this->_offsets[node]);
+  };
+
+  for (uint32_t root = 0; root < this->_names.size(); root++) {
+    if (index[root] != unvisited)
+      continue;
+    visit(root);
+    while (!calls.empty()) {
+      uint32_t node = calls.back().first;
+      uint32_t edge = calls.back().second;
+
+      if (edge < this->_offsets[node + 1]) {
+        uint32_t next = this->_edges[edge];
+
+        calls.back().second++;
+        if (index[next] == unvisited)
+          visit(next);
+        else if (onStack[next])
+          low[node] = std::min(low[node], index[next]);
+        continue;
+      }
+      calls.pop_back();
+      if (!calls.empty())
+        low[calls.back().first] = std::min(low[calls.back().first], low[node]);
+      if (low[node] != index[node])
+        continue;
+      size_t first = stack.size();
+
+      do {
+        onStack[stack[--first]] = false;
+      } while (stack[first] != node);
+      if (stack.size() - first > 1 || std::find(this->prerequisites(node).begin(), this->prerequisites(node).end(), node) != this->prerequisites(node).end()) {
+        components.emplace_back(stack.begin() + first, stack.end());
+        std::sort(components.back().begin(), components.back().end());
+      }
+      stack.resize(first);
+    }
+  }
+  std::sort(components.begin(), components.end());
+  return components;
+}
+
+std::vector<uint32_t> Graph::missingPhony() const
+{
+  std::vector<uint32_t> nodes;
+
+  for (uint32_t node = 0; node < this->_names.size(); node++) {
+    std::string_view name = this->_names[node];
+
+    if ((this->_flags[node] & (Rule | Phony)) != Rule || name.find_first_of("./%$") != std::string_view::npos)
+      continue;
+    if (std::find(std::begin(phonyNames), std::end(phonyNames), name) != std::end(phonyNames) ||
+        (!(this->_flags[node] & Commands) && !this->prerequisites(node).empty()))
+      nodes.push_back(node);
+  }
+  return nodes;
+}
+
+uint32_t Graph::_intern(std::string_view name)
+{
+  auto found = this->_ids.find(name);
+
+  if (found != this->_ids.end())
+    return found->second;
+  name = this->_arena.store(name);
+  this->_ids.emplace(name, this->_names.size());
+  this->_names.push_back(name);
+  this->_lines.push_back(0);
+  this->_flags.push_back(0);
+  return this->_names.size() - 1;
+}
+
+void Graph::_index(size_t nodes, const std::vector<std::pair<uint32_t, uint32_t>> &pairs, bool reverse, std::vector<uint32_t> &offsets, std::vector<uint32_t> &edges)
+{
+  offsets.assign(nodes + 1, 0);
+  edges.resize(pairs.size());
+  for (const auto &[from, to]: pairs)
+    offsets[(reverse ? to : from) + 1]++;
+  for (size_t i = 0; i < nodes; i++)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+
+  for (const auto &[from, to]: pairs)
+    edges[cursor[reverse ? to : from]++] = (reverse ? from : to);
+}
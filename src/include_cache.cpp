@@ -0,0 +1,177 @@
+#include <glob.h>
+#include <climits>
+#include <cstdlib>
+#include <unordered_set>
+#include "expander.hpp"
+#include "hash.hpp"
+#include "include_cache.hpp"
+#include "stats.hpp"
+
+static std::string canonicalPath(const std::string &path)
+{
+  char resolved[PATH_MAX];
+
+  if (realpath(path.c_str(), resolved) == nullptr)
+    return std::string();
+  return resolved;
+}
+
+static std::string directoryOf(const std::string &path)
+{
+  size_t slash = path.find_last_of('/');
+
+  if (slash == std::string::npos)
+    return ".";
+  return (slash == 0 ? "/" : path.substr(0, slash));
+}
+
+IncludeCache::IncludeCache(const std::vector<std::string> &directories) : _directories(directories)
+{}
+
+std::vector<std::shared_ptr<const Makefile>> IncludeCache::resolve(const Makefile &makefile, std::vector<std::string> &dependencies)
+{
+  std::vector<std::shared_ptr<const Makefile>> fragments;
+  std::unordered_set<std::string> seen = {canonicalPath(makefile.getPath())};
+  std::vector<std::string> stack;
+  std::vector<std::string> paths;
+
+  dependencies.clear();
+  this->_find(makefile, paths, dependencies);
+  stack.assign(paths.rbegin(), paths.rend());
+  while (!stack.empty()) {
+    std::string path = std::move(stack.back());
+
+    stack.pop_back();
+    if (!seen.insert(path).second)
+      continue;
+    std::shared_ptr<Slot> slot = this->_get(path);
+
+    dependencies.push_back(path);
+    if (slot->makefile == nullptr)
+      continue;
+    fragments.push_back(slot->makefile);
+    paths.clear();
+    this->_find(*slot->makefile, paths, dependencies);
+    stack.insert(stack.end(), paths.rbegin(), paths.rend());
+  }
+  return fragments;
+}
+
+bool IncludeCache::invalidate(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+
+  return this->_slots.erase(path) > 0;
+}
+
+uint64_t IncludeCache::fingerprint() const
+{
+  uint64_t hash = this->_directories.size();
+
+  for (const std::string &directory: this->_directories)
+    hash = hash64(directory, hash);
+  return hash;
+}
+
+bool IncludeCache::mentions(std::string_view content)
+{
+  for (size_t pos = content.find("include"); pos != std::string_view::npos; pos = content.find("include", pos + 1)) {
+    size_t begin = pos;
+
+    if (pos + 7 >= content.size() || !std::isspace(static_cast<unsigned char>(content[pos + 7])))
+      continue;
+    if (begin > 0 && (content[begin - 1] == '-' || content[begin - 1] == 's'))
+      begin--;
+    while (begin > 0 && (content[begin - 1] == ' ' || content[begin - 1] == '\t'))
+      begin--;
+    if (begin == 0 || content[begin - 1] == '\n')
+      return true;
+  }
+  return false;
+}
+
+std::shared_ptr<IncludeCache::Slot> IncludeCache::_get(const std::string &path)
+{
+  std::shared_ptr<Slot> slot;
+
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    std::shared_ptr<Slot> &found = this->_slots[path];
+
+    if (found == nullptr)
+      found = std::make_shared<Slot>();
+    slot = found;
+  }
+  std::call_once(slot->once, [&slot, &path]() {
+    try {
+      MappedFile file;
+
+      {
+        Stats::Timer timer(Stats::Read);
+
+        file = MappedFile(path);
+        Stats::bytes(file.size());
+      }
+      slot->makefile = std::make_shared<const Makefile>(path, std::move(file));
+    }
+    catch (const MakefileException &e) {
+      slot->makefile.reset();
+    }
+  });
+  return slot;
+}
+
+void IncludeCache::_find(const Makefile &makefile, std::vector<std::string> &paths, std::vector<std::string> &dependencies) const
+{
+  std::unique_ptr<Expander> expander;
+  std::string directory = directoryOf(makefile.getPath());
+
+  for (const Makefile::Include &include: makefile.includes()) {
+    std::string_view names = include.path;
+    std::string expanded;
+
+    if (names.find('$') != std::string_view::npos) {
+      if (expander == nullptr)
+        expander = std::make_unique<Expander>(makefile);
+      expanded = expander->expand(names);
+      names = expanded;
+    }
+    for (std::string_view name: Words(names)) {
+      if (name.find_first_of("*?[") == std::string_view::npos) {
+        std::string path = this->_locate(name, directory, dependencies);
+
+        if (!path.empty())
+          paths.push_back(std::move(path));
+        continue;
+      }
+      std::string pattern = (name[0] == '/' ? std::string(name) : directory + "/" + std::string(name));
+      glob_t matches;
+
+      dependencies.push_back(directoryOf(pattern));
+      if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+        for (size_t i = 0; i < matches.gl_pathc; i++) {
+          std::string path = canonicalPath(matches.gl_pathv[i]);
+
+          if (!path.empty())
+            paths.push_back(std::move(path));
+        }
+      }
+      globfree(&matches);
+    }
+  }
+}
+
+std::string IncludeCache::_locate(std::string_view name, const std::string &directory, std::vector<std::string> &dependencies) const
+{
+  std::string candidate = (name[0] == '/' ? std::string(name) : directory + "/" + std::string(name));
+  std::string path = canonicalPath(candidate);
+
+  for (size_t i = 0; path.empty() && name[0] != '/' && i < this->_directories.size(); i++) {
+    dependencies.push_back(std::move(candidate));
+    candidate = this->_directories[i] + "/" + std::string(name);
+    path = canonicalPath(candidate);
+  }
+  if (path.empty())
+    dependencies.push_back(std::move(candidate));
+  return path;
+}
@@ -1,22 +1,230 @@
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include "argument.hpp"
+#include "include_cache.hpp"
 #include "makefile.hpp"
+#include "ordered_output.hpp"
+#include "result_cache.hpp"
 #include "rules.hpp"
+#include "scheduler.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "walker.hpp"
+
+struct Context {
+  const Rules &rules;
+  IncludeCache &includes;
+  Scheduler *scheduler;
+  ResultCache *cache;
+  unsigned int branches;
+  DiagnosticSink::Format format;
+  bool verbose;
+};
+
+static const size_t splitThreshold = 4096;
+
+static int checkParsed(const Makefile &makefile, const Context &context, DiagnosticSink &sink)
+{
+  Stats::Timer timer(Stats::Check);
+  Scheduler::TaskGroup group;
+  DiagnosticBuffer variables;
+  int variablesFound = 0;
+  int found;
+
+  if (context.scheduler == nullptr || makefile.receipes().size() + makefile.variables().size() < splitThreshold)
+    return context.rules.check(makefile, sink);
+  context.scheduler->spawn(group, [&context, &makefile, &variables, &variablesFound]() {
+    variablesFound = context.rules.checkVariables(makefile, variables);
+  });
+  found = context.rules.checkRules(makefile, sink);
+  context.scheduler->wait(group);
+  variables.replay(sink);
+  return found + variablesFound + context.rules.checkGraph(makefile, sink);
+}
+
+static int checkBranches(Makefile &makefile, const Context &context, DiagnosticSink &sink)
+{
+  std::vector<uint32_t> arms = makefile.branches();
+  std::vector<uint32_t> selection(arms.size(), 0);
+  UniqueSink unique(sink);
+  size_t carry = 0;
+
+  if (context.branches == 0 || arms.empty())
+    return checkParsed(makefile, context, sink);
+  for (unsigned int n = 0; n < context.branches && carry < arms.size(); n++) {
+    makefile.select(selection);
+    checkParsed(makefile, context, unique);
+    for (carry = 0; carry < selection.size() && ++selection[carry] == arms[carry]; carry++)
+      selection[carry] = 0;
+  }
+  makefile.select({});
+  return unique.size();
+}
+
+static MappedFile readMakefile(const std::string &path)
+{
+  Stats::Timer timer(Stats::Read);
+  MappedFile file(path);
+
+  Stats::bytes(file.size());
+  return file;
+}
+
+static int checkMakefile(const std::string &path, const Context &context, std::ostream &out, std::ostream &err)
+{
+  Stats::File record(path);
+
+  try {
+    MappedFile file = readMakefile(path);
+    std::unique_ptr<DiagnosticSink> sink = DiagnosticSink::create(context.format, out);
+    DiagnosticBuffer diagnostics;
+    std::vector<std::string> dependencies;
+    uint64_t key = 0;
+
+    bool includes = IncludeCache::mentions(file.view());
+
+    if (context.cache != nullptr) {
+      key = context.cache->key(file.view());
+      if (context.branches > 0)
+        key = context.cache->key(key, context.branches);
+      if (includes)
+        key = context.cache->key(key, context.includes.fingerprint());
+      if ((includes ? context.cache->lookup(key, dependencies) && context.cache->lookup(context.cache->key(key, ResultCache::signature(dependencies)), diagnostics) : context.cache->lookup(key, diagnostics))) {
+        diagnostics.replay(*sink, path);
+        return (diagnostics.size() > 0 ? 1 : 0);
+      }
+    }
+    Makefile makefile(path, std::move(file), context.verbose, out);
+
+    if (includes) {
+      Stats::Timer timer(Stats::Includes);
+
+      makefile.resolveIncludes(context.includes);
+    }
+    if (context.cache == nullptr) {
+      TimedSink output(*sink);
+
+      return (checkBranches(makefile, context, output) > 0 ? 1 : 0);
+    }
+    if (includes) {
+      context.cache->store(key, makefile.dependencies());
+      key = context.cache->key(key, ResultCache::signature(makefile.dependencies()));
+    }
+    checkBranches(makefile, context, diagnostics);
+    context.cache->store(key, diagnostics);
+    diagnostics.replay(*sink);
+    return (diagnostics.size() > 0 ? 1 : 0);
+  }
+  catch (const MakefileException &e) {
+    err << "checkmake: " << e.what() << "\n";
+    return 1;
+  }
+}
+
+static int checkRecursive(const Argument &arg, Context context)
+{
+  Scheduler pool(arg.getJobs());
+  Walker walker(arg.getSkipDirectories());
+  std::vector<std::string> paths = walker.discover(Walker::root(arg.getMakefilePath()), pool);
+  OrderedOutput output(paths.size(), (context.format == DiagnosticSink::Sarif ? ",\n" : ""));
+  std::atomic<size_t> next(0);
+  std::atomic<int> status(0);
+
+  context.scheduler = &pool;
+  std::cout.flush();
+  for (unsigned int worker = 0; worker < pool.size(); worker++) {
+    pool.submit([&context, &paths, &output, &next, &status]() {
+      for (size_t i = next++; i < paths.size(); i = next++) {
+        std::ostringstream out;
+        std::ostringstream err;
+
+        output.wait(i);
+        if (context.verbose)
+          out << "=== " << paths[i] << " ===\n";
+        if (checkMakefile(paths[i], context, out, err) != 0)
+          status = 1;
+        output.complete(i, out.str(), err.str());
+      }
+    });
+  }
+  pool.wait();
+  output.flush();
+  return status;
+}
 
 int main(int argc, char **argv)
 {
   Argument arg(argc, argv);
+  std::unique_ptr<ResultCache> cache;
+  int status;
 
   if (!arg)
     return (-1);
+  if (arg.isStats())
+    Stats::enable();
+  if (!arg.getTracePath().empty())
+    Trace::enable();
   if (arg.isVerbose()) {
-    std::cout << "Makefile path = " << arg.getMakefilePath() << std::endl;
-    std::cout << "Rules path = " << arg.getRulesPath() << std::endl;
-    std::cout << "Recursive is " << (arg.isRecursive() ? "on" : "off") << std::endl;
-    std::cout << "Verbose is " << (arg.isVerbose() ? "on" : "off") << std::endl;
+    std::cout << "Makefile path = " << arg.getMakefilePath() << "\n";
+    std::cout << "Rules path = " << arg.getRulesPath() << "\n";
+    std::cout << "Recursive is " << (arg.isRecursive() ? "on" : "off") << "\n";
+    if (arg.isRecursive())
+      std::cout << "Jobs = " << arg.getJobs() << "\n";
+    std::cout << "Verbose is " << (arg.isVerbose() ? "on" : "off") << "\n";
   }
-  Makefile makefile(arg.getMakefilePath(), arg.isVerbose());
-  Rules rules(arg.getRulesPath(), arg.isVerbose());
+  if (arg.isClient() || arg.isServing()) {
+    try {
+      if (arg.isClient())
+        return Server::request(arg.getSocketPath(), arg.getMakefilePath(), std::cout);
+      Server server(arg.getSocketPath(), arg.getRulesPath(), arg.getIncludeDirectories(), arg.isVerbose());
 
-  return rules.check(makefile);
+      server.run();
+      return 0;
+    }
+    catch (const MakefileException &e) {
+      std::cerr << "checkmake: " << e.what() << std::endl;
+      return 2;
+    }
+  }
+  if (!arg.isRecursive() && arg.isVerbose()) {
+    Makefile makefile(arg.getMakefilePath(), arg.isVerbose());
+    Rules rules(arg.getRulesPath(), arg.isVerbose());
+    IncludeCache includes(arg.getIncludeDirectories());
+    TextSink sink(std::cout);
+
+    makefile.resolveIncludes(includes);
+    status = (rules.check(makefile, sink) > 0 ? 1 : 0);
+  }
+  else {
+    Rules rules(arg.getRulesPath(), arg.isVerbose(), arg.getCachePath());
+    IncludeCache includes(arg.getIncludeDirectories());
+
+    if (!arg.getCachePath().empty() && !arg.isVerbose())
+      cache = std::make_unique<ResultCache>(arg.getCachePath(), rules.fingerprint());
+    Context context = {rules, includes, nullptr, cache.get(), arg.getBranches(), (arg.isVerbose() ? DiagnosticSink::Text : arg.getFormat()), arg.isVerbose()};
+
+    DiagnosticSink::begin(context.format, std::cout);
+    if (arg.isRecursive())
+      status = checkRecursive(arg, context);
+    else
+      status = checkMakefile(arg.getMakefilePath(), context, std::cout, std::cerr);
+    DiagnosticSink::end(context.format, std::cout);
+    if (cache != nullptr)
+      cache->flush();
+  }
+  if (arg.isStats())
+    Stats::report(std::cerr, arg.getSlowest());
+  if (!arg.getTracePath().empty()) {
+    try {
+      Trace::write(arg.getTracePath());
+    }
+    catch (const MakefileException &e) {
+      std::cerr << "checkmake: " << e.what() << std::endl;
+      status = 2;
+    }
+  }
+  return status;
 }
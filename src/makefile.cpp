@@ -1,199 +1,1511 @@
+#include "expander.hpp"
+#include "include_cache.hpp"
 #include "makefile.hpp"
+#include "overlay.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
 
-Makefile::Makefile(const std::string &makefilePath, bool verbose) : _makefilePath(makefilePath), _verbose(verbose)
+Makefile::Makefile(const std::string &makefilePath, bool verbose, std::ostream &out) : Makefile(makefilePath, MappedFile(makefilePath), verbose, out)
+{}
+
+Makefile::Makefile(const std::string &makefilePath, MappedFile &&file, bool verbose, std::ostream &out) : _makefilePath(makefilePath), _verbose(verbose), _file(std::move(file)), _arena(_file.size() + _file.size() / 2 + 4096), _variables(_arena.resource()), _receipes(_arena.resource()), _cmds(_arena.resource()), _makefile(_arena.resource()), _phonies(_arena.resource()), _scopes(_arena.resource()), _counts(), _recipePrefix('\t'), _recipePrefixes(0), _conditionals(0), _expansions(0), _generation(0), _size(0), _edited(0), _indexed(false)
 {
-  std::string line;
-  std::ifstream file(makefilePath);
+  this->_parse(this->_file.view());
+  if (this->_verbose)
+    this->_dump(out);
+}
 
-  if (!file.is_open()) {
-    throw MakefileException("Failed to open " + makefilePath);
-  }
-  while (std::getline(file, line)) {
-    this->_makefile.push_back(line);
-  }
+Makefile::Makefile(const std::string &makefilePath, std::string &&content, bool verbose, std::ostream &out) : _makefilePath(makefilePath), _verbose(verbose), _content(std::move(content)), _arena(_content.size() + _content.size() / 2 + 4096), _variables(_arena.resource()), _receipes(_arena.resource()), _cmds(_arena.resource()), _makefile(_arena.resource()), _phonies(_arena.resource()), _scopes(_arena.resource()), _counts(), _recipePrefix('\t'), _recipePrefixes(0), _conditionals(0), _expansions(0), _generation(0), _size(0), _edited(0), _indexed(false)
+{
+  this->_parse(this->_content);
+  if (this->_verbose)
+    this->_dump(out);
+}
+
+static std::string_view storeEpured(std::string_view str, Arena &arena)
+{
+  char *out;
+
+  str = trim(str);
+  if (isEpured(str))
+    return str;
+  out = arena.allocate(str.size());
+  return std::string_view(out, epur(str, out));
+}
 
-  this->_cleanMakefile();
+static Makefile::Variable::Flavor flavorOf(char op)
+{
+  if (op == ':')
+    return Makefile::Variable::Simple;
+  if (op == '!')
+    return Makefile::Variable::Shell;
+  return Makefile::Variable::Recursive;
+}
+
+void Makefile::_parse(std::string_view content)
+{
+  this->_cleanMakefile(content);
+  this->_extract();
+}
+
+void Makefile::_extract()
+{
+  Stats::Timer timer(Stats::Extract);
+  std::pmr::memory_resource *resource = this->_arena.resource();
+
+  this->_generation++;
+  Variables(resource).swap(this->_variables);
+  std::pmr::vector<Receipe>(resource).swap(this->_receipes);
+  std::pmr::vector<std::string_view>(resource).swap(this->_cmds);
+  std::pmr::vector<Receipe>(resource).swap(this->_phonies);
+  std::pmr::vector<Scope>(resource).swap(this->_scopes);
+  this->_phony = std::string_view();
   this->_extractVariables();
-  this->_extractVariableModifiers();
   this->_extractReceipes();
   this->_extractPhony();
-  if (this->_verbose) {
-    std::cout << "=== Makefile variable begin ===" << std::endl;
-    std::cout << this->getVariables() << std::endl;
-    std::cout << "=== Makefile variable end ===" << std::endl;
-    std::cout << "=== Makefile receipes begin ===" << std::endl;
-    std::cout << this->getReceipes() << std::endl;
-    std::cout << "=== Makefile receipes end ===" << std::endl;
-    if (!this->_phony.empty()) {
-      std::cout << "=== Makefile .PHONY begin ===" << std::endl;
-      std::cout << this->_phony << std::endl;
-      std::cout << "=== Makefile .PHONY end ===" << std::endl;
+  this->_collectScopes(0, this->_makefile.size(), this->_scopes);
+}
+
+void Makefile::_dump(std::ostream &out) const
+{
+  out << "=== Makefile variable begin ===" << "\n";
+  out << this->getVariables() << "\n";
+  out << "=== Makefile variable end ===" << "\n";
+  out << "=== Makefile receipes begin ===" << "\n";
+  out << this->getReceipes() << "\n";
+  out << "=== Makefile receipes end ===" << "\n";
+  if (!this->_phony.empty()) {
+    out << "=== Makefile .PHONY begin ===" << "\n";
+    out << this->_phony << "\n";
+    out << "=== Makefile .PHONY end ===" << "\n";
+  }
+  if (!this->_scopes.empty()) {
+    out << "=== Makefile target variables begin ===" << "\n";
+    out << this->getTargetVariables() << "\n";
+    out << "=== Makefile target variables end ===" << "\n";
+  }
+}
+
+static const std::string_view directives[] = {
+  "include", "-include", "sinclude",
+  "define", "endef", "undefine",
+  "ifeq", "ifneq", "ifdef", "ifndef", "else", "endif",
+  "vpath", "export", "unexport", "override"
+};
+
+static const std::string_view conditionals[] = {
+  "ifeq", "ifneq", "ifdef", "ifndef"
+};
+
+static bool isConditional(std::string_view word)
+{
+  return std::find(std::begin(conditionals), std::end(conditionals), word) != std::end(conditionals);
+}
+
+static std::string_view firstWord(std::string_view line, size_t pos)
+{
+  size_t end = pos;
+
+  while (end < line.size() && !std::isspace(static_cast<unsigned char>(line[end])) && line[end] != '(')
+    end++;
+  return line.substr(pos, end - pos);
+}
+
+static size_t skipSpaces(std::string_view line, size_t pos)
+{
+  while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos])))
+    pos++;
+  return pos;
+}
+
+static size_t findTopLevel(std::string_view line, size_t pos, std::string_view chars)
+{
+  int depth = 0;
+
+  for (; pos < line.size(); pos++) {
+    char c = line[pos];
+
+    if (c == '$' && pos + 1 < line.size() && (line[pos + 1] == '(' || line[pos + 1] == '{')) {
+      depth++;
+      pos++;
     }
+    else if (depth > 0 && (c == '(' || c == '{'))
+      depth++;
+    else if (depth > 0 && (c == ')' || c == '}'))
+      depth--;
+    else if (depth == 0 && chars.find(c) != std::string_view::npos)
+      return pos;
   }
+  return std::string_view::npos;
 }
 
-bool Makefile::_isVariable(const std::string &line) const
+static size_t defineKeyword(std::string_view line)
 {
-  int found = line.find_first_of("=:+");
+  size_t pos = skipSpaces(line, 0);
 
-  if (this->_isReceipeCommand(line))
-    return false;
-  if (found < 0)
-    return false;
-  if (line[found] == '+')
-    return false;
-  return line[found] == '=' || (line[found] == ':' && line[found + 1] == '=');
+  for (std::string_view word = firstWord(line, pos); !word.empty(); word = firstWord(line, pos)) {
+    if (word == "define")
+      return pos + word.size();
+    if (word != "override" && word != "export")
+      break;
+    pos = skipSpaces(line, pos + word.size());
+  }
+  return std::string_view::npos;
 }
 
-bool Makefile::_isVariableModifier(const std::string &line) const 
+static size_t findComment(std::string_view line)
 {
-  int found = line.find("+=");
-  int foundFirst = line.find_first_of("=:");
+  for (size_t pos = line.find('#'); pos != std::string_view::npos; pos = line.find('#', pos + 1)) {
+    if (pos == 0 || line[pos - 1] != '\\')
+      return pos;
+  }
+  return std::string_view::npos;
+}
 
-  if (this->_isReceipeCommand(line))
-    return false;
-  if (found < 0)
-    return false;
-  if (line[foundFirst] == ':')
-    return false;
-  return true;
+Makefile::Line Makefile::_classifyLine(std::string_view text, size_t comment)
+{
+  Line line = {text, Line::Other, 0, true, false, 0, 0, 0, static_cast<uint32_t>(text.size()), 0};
+  size_t start;
+  size_t begin;
+  size_t found;
+
+  if (this->_isReceipeCommand(text)) {
+    line.kind = Line::ReceipeCommand;
+    line.valueBegin = 1;
+    return line;
+  }
+  if (comment < text.size()) {
+    text = text.substr(0, comment);
+    line.text = text;
+    line.valueEnd = text.size();
+  }
+  start = skipSpaces(text, 0);
+  begin = start;
+  for (std::string_view word = firstWord(text, begin); !word.empty(); word = firstWord(text, begin)) {
+    if (std::find(std::begin(directives), std::end(directives), word) == std::end(directives))
+      break;
+    if (word != "export" && word != "override" && word != "unexport") {
+      line.kind = Line::Directive;
+      line.nameBegin = begin;
+      line.nameEnd = begin + word.size();
+      line.valueBegin = skipSpaces(text, line.nameEnd);
+      return line;
+    }
+    begin = skipSpaces(text, begin + word.size());
+  }
+  found = findTopLevel(text, begin, ":=");
+  if (found == std::string_view::npos) {
+    if (begin > start) {
+      line.kind = Line::Directive;
+      line.valueBegin = begin;
+    }
+    return line;
+  }
+  line.nameBegin = begin;
+  line.nameEnd = found;
+  if (text[found] == '=') {
+    line.op = '=';
+    if (found > begin && (text[found - 1] == '+' || text[found - 1] == '?' || text[found - 1] == '!')) {
+      line.op = text[found - 1];
+      line.nameEnd = found - 1;
+    }
+    line.kind = (line.op == '+' ? Line::VariableModifier : Line::Variable);
+    line.valueBegin = found + 1;
+    return line;
+  }
+  size_t end = found + 1;
+
+  while (end < text.size() && text[end] == ':')
+    end++;
+  if (end < text.size() && text[end] == '=') {
+    line.kind = Line::Variable;
+    line.op = ':';
+    line.valueBegin = end + 1;
+    return line;
+  }
+  line.kind = Line::ReceipeTarget;
+  line.op = ':';
+  line.valueBegin = end;
+  found = findTopLevel(text, end, "=;");
+  if (found != std::string_view::npos && text[found] == '=') {
+    line.kind = Line::TargetVariable;
+    line.op = '=';
+    line.nameBegin = end;
+    line.nameEnd = found;
+    if (found > end && std::string_view("+?!:").find(text[found - 1]) != std::string_view::npos) {
+      line.op = text[found - 1];
+      line.nameEnd = found - 1;
+    }
+    while (line.nameEnd > end && text[line.nameEnd - 1] == ':')
+      line.nameEnd--;
+    for (size_t colon = findTopLevel(text, end, ":"); colon < line.nameEnd; colon = findTopLevel(text, colon + 1, ":"))
+      line.nameBegin = colon + 1;
+    line.nameBegin = skipSpaces(text, line.nameBegin);
+    for (std::string_view word = firstWord(text, line.nameBegin); word == "override" || word == "export" || word == "private" || word == "unexport"; word = firstWord(text, line.nameBegin))
+      line.nameBegin = skipSpaces(text, line.nameBegin + word.size());
+    line.valueBegin = found + 1;
+    return line;
+  }
+  if (found != std::string_view::npos)
+    line.valueEnd = found;
+  return line;
 }
 
-bool Makefile::_isReceipeTarget(const std::string &line) const
+bool Makefile::_isReceipeCommand(std::string_view line) const
 {
-  int found = line.find_first_of("=:");
+  return !line.empty() && line[0] == this->_recipePrefix;
+}
 
-  if (this->_isVariable(line))
-    return false;
-  if (line[found] != ':')
+bool Makefile::_isBranch(const Line &line) const
+{
+  if (line.kind != Line::Directive)
     return false;
-  return true;
+  return isConditional(line.name()) || line.name() == "else" || line.name() == "endif";
 }
 
-bool Makefile::_isReceipeCommand(const std::string &line) const
+bool Makefile::_isBranching(const Line &line) const
 {
-  auto found = this->_variables.find(".RECIPEPREFIX");
-  std::string recipePrefix;
+  return !line.active || this->_isBranch(line);
+}
+
+bool Makefile::_isEager(const Line &line) const
+{
+  if ((line.kind != Line::Variable || line.op != ':') && line.kind != Line::VariableModifier)
+    return false;
+  return line.value().find('$') != std::string_view::npos;
+}
+
+void Makefile::_cleanMakefile(std::string_view content) {
+  Stats::Timer timer(Stats::Clean);
+  std::vector<std::string_view> lineToReconstituate;
+  Scanner::Result scan;
+  size_t lineStart = 0;
+  size_t hash = 0;
+  uint32_t lineno = 0;
+  size_t defineStart = 0;
+  size_t defineHeader = 0;
+  unsigned defineDepth = 0;
+
+  Scanner::scan(content, scan);
+  this->_makefile.reserve(scan.lineEnds.size() + scan.lineEnds.size() / 8 + 64);
+  for (size_t i = 0; i < scan.lineEnds.size(); i++) {
+    std::string_view line = content.substr(lineStart, scan.lineEnds[i] - lineStart);
+    size_t comment = std::string_view::npos;
 
-  if (found != this->_variables.end()) {
-    recipePrefix = this->_variables.at(".RECIPEPREFIX");
+    if (defineDepth > 0) {
+      std::string_view word = (this->_isReceipeCommand(line) ? std::string_view() : firstWord(line, skipSpaces(line, 0)));
+
+      if (defineKeyword(line) != std::string_view::npos)
+        defineDepth++;
+      else if (word == "endef" && --defineDepth == 0)
+        this->_pushDefine(this->_makefile, content.substr(defineStart, std::max(lineStart, defineStart + defineHeader + 1) - 1 - defineStart), defineHeader, lineno);
+      lineStart = scan.lineEnds[i] + 1;
+      continue;
+    }
+
+    while (hash < scan.hashes.size() && scan.hashes[hash] < lineStart)
+      hash++;
+    for (size_t j = hash; j < scan.hashes.size() && scan.hashes[j] < scan.lineEnds[i]; j++) {
+      if (scan.hashes[j] == lineStart || content[scan.hashes[j] - 1] != '\\') {
+        comment = scan.hashes[j] - lineStart;
+        break;
+      }
+    }
+    lineStart = scan.lineEnds[i] + 1;
+    if (lineToReconstituate.empty())
+      lineno = i + 1;
+    if (line.empty() || (scan.flags[i] & Scanner::Comment)) {
+      continue;
+    }
+    else if (scan.flags[i] & Scanner::Continuation) {
+      line.remove_suffix(1);
+      lineToReconstituate.push_back(line);
+      continue;
+    }
+    else if (!lineToReconstituate.empty()) {
+      lineToReconstituate.push_back(line);
+      line = this->_joinLines(lineToReconstituate);
+      lineToReconstituate.clear();
+      comment = findComment(line);
+    }
+    else if (!this->_isReceipeCommand(line) && defineKeyword(line.substr(0, comment)) != std::string_view::npos) {
+      defineStart = scan.lineEnds[i] - line.size();
+      defineHeader = line.size();
+      defineDepth = 1;
+      continue;
+    }
+    this->_pushLine(this->_makefile, line, comment, lineno);
   }
-  else {
-    recipePrefix = "\t";
+  if (!lineToReconstituate.empty()) {
+    std::string_view line = this->_joinLines(lineToReconstituate);
+
+    this->_pushLine(this->_makefile, line, findComment(line), lineno);
+  }
+  if (defineDepth > 0) {
+    std::string_view text = content.substr(defineStart);
+
+    if (!text.empty() && text.back() == '\n')
+      text.remove_suffix(1);
+    this->_pushDefine(this->_makefile, text, defineHeader, lineno);
   }
-  return starts_with(line, recipePrefix);
+  Stats::lines(scan.lineEnds.size(), this->_makefile.size());
 }
 
-void Makefile::_cleanMakefile() {
-  std::string reconstituedLine;
-  std::list<std::string> lineToReconstituate;
-  bool previousLineIsBackslashEnded = false;
-  auto it = this->_makefile.begin();
+bool Makefile::_cleanLines(size_t first, size_t last, std::pmr::vector<Line> &lines)
+{
+  std::vector<std::string_view> lineToReconstituate;
+  std::vector<std::string_view> define;
+  uint32_t lineno = 0;
+  size_t defineHeader = 0;
+  unsigned defineDepth = 0;
+
+  for (size_t i = first; i < last; i++) {
+    std::string_view line = this->_lines[i];
 
-  while (it != this->_makefile.end()) {
-    std::string &line = *it;
+    if (!line.empty() && line.back() == '\n')
+      line.remove_suffix(1);
+    if (defineDepth > 0) {
+      std::string_view word = (this->_isReceipeCommand(line) ? std::string_view() : firstWord(line, skipSpaces(line, 0)));
 
-    if (line.empty() || starts_with(line, "#")) {
-      erase(this->_makefile, it);
+      if (defineKeyword(line) != std::string_view::npos)
+        defineDepth++;
+      else if (word == "endef" && --defineDepth == 0) {
+        line = this->_joinLines(define);
+        this->_pushDefine(lines, line.substr(0, line.size() - 1), defineHeader, lineno);
+        define.clear();
+        continue;
+      }
+      define.push_back(this->_lines[i]);
       continue;
-    } 
-    else if (ends_with(line, "\\")) {
-      line.pop_back();
+    }
+    if (lineToReconstituate.empty())
+      lineno = i + 1;
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (line.back() == '\\') {
+      line.remove_suffix(1);
       lineToReconstituate.push_back(line);
-      previousLineIsBackslashEnded = true;
-      erase(this->_makefile, it);
       continue;
     }
-    else if (!ends_with(line, "\\") && previousLineIsBackslashEnded) {
+    if (!lineToReconstituate.empty()) {
       lineToReconstituate.push_back(line);
-      while (!lineToReconstituate.empty()) {
-	reconstituedLine += lineToReconstituate.front();
-	lineToReconstituate.pop_front();
-      }
-      std::replace(it, std::next(it), line, reconstituedLine);
-      previousLineIsBackslashEnded = false;
+      line = this->_joinLines(lineToReconstituate);
+      lineToReconstituate.clear();
     }
-    it++;
+    else if (!this->_isReceipeCommand(line) && defineKeyword(line.substr(0, findComment(line))) != std::string_view::npos) {
+      define.push_back(this->_lines[i]);
+      defineHeader = line.size();
+      defineDepth = 1;
+      continue;
+    }
+    this->_pushLine(lines, line, findComment(line), lineno);
+  }
+  if (!lineToReconstituate.empty()) {
+    std::string_view line = this->_joinLines(lineToReconstituate);
+
+    this->_pushLine(lines, line, findComment(line), lineno);
   }
+  if (defineDepth > 0) {
+    std::string_view text = this->_joinLines(define);
+
+    if (last < this->_lines.size())
+      return false;
+    if (!text.empty() && text.back() == '\n')
+      text.remove_suffix(1);
+    this->_pushDefine(lines, text, defineHeader, lineno);
+  }
+  return true;
+}
+
+void Makefile::_pushLine(std::pmr::vector<Line> &lines, std::string_view text, size_t comment, uint32_t lineno)
+{
+  Line &line = lines.emplace_back(this->_classifyLine(text, comment));
+
+  line.lineno = lineno;
+  this->_counts[line.kind]++;
+  if (line.kind == Line::Directive && isConditional(line.name()))
+    this->_conditionals++;
+  if (line.kind == Line::Variable && trim(line.name()) == ".RECIPEPREFIX") {
+    std::string_view prefix = trim(line.value());
+
+    this->_recipePrefix = (prefix.empty() ? '\t' : prefix[0]);
+    this->_recipePrefixes++;
+  }
+}
+
+void Makefile::_pushDefine(std::pmr::vector<Line> &lines, std::string_view text, size_t header, uint32_t lineno)
+{
+  std::string_view head = text.substr(0, std::min(header, findComment(text.substr(0, header))));
+  size_t begin = skipSpaces(head, defineKeyword(head));
+  size_t equal = findTopLevel(head, begin, "=");
+  Line line = {text, Line::Variable, '=', true, true, static_cast<uint32_t>(begin), static_cast<uint32_t>(head.size()),
+               static_cast<uint32_t>(std::min(header + 1, text.size())), static_cast<uint32_t>(text.size()), lineno};
+
+  if (equal != std::string_view::npos) {
+    line.nameEnd = equal;
+    if (equal > begin && std::string_view("+?!:").find(head[equal - 1]) != std::string_view::npos)
+      line.op = head[equal - 1];
+    while (line.nameEnd > begin && std::string_view("+?!:").find(head[line.nameEnd - 1]) != std::string_view::npos)
+      line.nameEnd--;
+  }
+  while (line.nameEnd > begin && std::isspace(static_cast<unsigned char>(head[line.nameEnd - 1])))
+    line.nameEnd--;
+  if (line.op == '+')
+    line.kind = Line::VariableModifier;
+  lines.push_back(line);
+  this->_counts[line.kind]++;
+}
+
+std::string_view Makefile::_joinLines(const std::vector<std::string_view> &lines)
+{
+  size_t size = 0;
+  char *out;
+
+  for (std::string_view line: lines)
+    size += line.size();
+  out = this->_arena.allocate(size);
+  size = 0;
+  for (std::string_view line: lines) {
+    std::copy(line.begin(), line.end(), out + size);
+    size += line.size();
+  }
+  return std::string_view(out, size);
+}
+
+std::string_view Makefile::_epur(std::string_view str)
+{
+  return storeEpured(str, this->_arena);
 }
 
 void Makefile::_extractVariables()
 {
-  for (const std::string &line: this->_makefile) {
-    if (this->_isVariable(line)) {
-      int found = line.find_first_of("=:");
-      int equalPos = (line[found] == '=' ? found : found + 1);
-      std::string name(line, 0, found);
-      std::string content(line, equalPos + 1);
+  struct Branch {
+    bool parent;
+    bool active;
+    bool taken;
+    bool otherwise;
+    uint32_t choice;
+    uint32_t arm;
+  };
+  std::unordered_map<std::string_view, std::string> appended;
+  std::unique_ptr<Expander> expander;
+  std::vector<Branch> stack;
+  std::string expanded;
+  bool active = true;
+  auto decide = [this, &expander, &stack](std::string_view directive, std::string_view args) {
+    Branch &branch = stack.back();
+    bool condition;
 
-      epur(name);
-      epur(content);
-      this->_variables[name] = content;
+    if (!branch.parent || branch.taken)
+      condition = false;
+    else if (branch.choice < this->_forced.size())
+      condition = (this->_forced[branch.choice] == branch.arm);
+    else if (directive.empty())
+      condition = true;
+    else {
+      if (expander == nullptr)
+        expander = std::make_unique<Expander>(*this);
+      condition = this->_condition(directive, args, *expander);
     }
+    branch.active = condition;
+    branch.taken = branch.taken || condition;
+  };
+
+  this->_branches.clear();
+  this->_sites.clear();
+  this->_expansions = 0;
+  for (size_t i = 0; i < this->_makefile.size(); i++) {
+    Line &line = this->_makefile[i];
+
+    line.active = active;
+    if (this->_isBranch(line) || this->_isEager(line))
+      this->_sites.push_back({static_cast<uint32_t>(i), std::string_view()});
+    if (this->_conditionals > 0 && line.kind == Line::Directive) {
+      std::string_view directive = line.name();
+
+      if (isConditional(directive)) {
+        stack.push_back({active, false, false, false, static_cast<uint32_t>(this->_branches.size()), 0});
+        this->_branches.push_back(1);
+        decide(directive, line.value());
+      }
+      else if (directive == "else" && !stack.empty()) {
+        std::string_view rest = line.value();
+        std::string_view word = firstWord(rest, 0);
+
+        stack.back().arm++;
+        this->_branches[stack.back().choice] = stack.back().arm + 1;
+        if (isConditional(word))
+          decide(word, rest.substr(skipSpaces(rest, word.size())));
+        else {
+          stack.back().otherwise = true;
+          decide(std::string_view(), std::string_view());
+        }
+      }
+      else if (directive == "endif" && !stack.empty()) {
+        if (!stack.back().otherwise)
+          this->_branches[stack.back().choice]++;
+        stack.pop_back();
+      }
+      active = (stack.empty() || stack.back().active);
+      continue;
+    }
+    if (!active || (line.kind != Line::Variable && line.kind != Line::VariableModifier))
+      continue;
+    std::string_view name = this->_arena.intern(this->_epur(line.name()));
+    std::string_view content = (line.multiline ? line.value() : this->_epur(line.value()));
+    auto found = this->_variables.find(name);
+    bool simple = (line.kind == Line::Variable ? line.op == ':' : found != this->_variables.end() && found->second.flavor == Variable::Simple);
+
+    if (simple && content.find('$') != std::string_view::npos) {
+      if (expander == nullptr)
+        expander = std::make_unique<Expander>(*this);
+      expanded = expander->expand(content);
+      content = this->_sites.back().value = this->_arena.store(expanded);
+      this->_expansions++;
+    }
+    if (line.kind == Line::VariableModifier && found != this->_variables.end()) {
+      std::string &value = appended.try_emplace(name, found->second.value).first->second;
+
+      if (!value.empty() && !content.empty())
+        value += ' ';
+      value += content;
+      found->second.value = value;
+    }
+    else if (found == this->_variables.end())
+      found = this->_variables.emplace(name, Variable{this->_arena.store(content), line.lineno, flavorOf(line.op), this->_generation}).first;
+    else if (line.op != '?') {
+      found->second.value = this->_arena.store(content);
+      found->second.flavor = flavorOf(line.op);
+      appended.erase(name);
+    }
+    else
+      continue;
+    if (expander != nullptr) {
+      found->second.generation = ++this->_generation;
+      expander->invalidate(name);
+    }
+  }
+  for (const auto &[name, value]: appended)
+    this->_variables.at(name).value = this->_arena.store(value);
+}
+
+bool Makefile::_condition(std::string_view directive, std::string_view args, Expander &expander) const
+{
+  std::string_view left;
+  std::string_view right;
+
+  args = trim(args);
+  if (directive == "ifdef" || directive == "ifndef") {
+    std::string name(trim(expander.expand(args)));
+    const Variable *variable = expander.variable(name);
+    bool defined = (variable != nullptr && !variable->value.empty());
+
+    return defined == (directive == "ifdef");
+  }
+  if (!args.empty() && args[0] == '(' && args.back() == ')') {
+    std::string_view inner = args.substr(1, args.size() - 2);
+    size_t comma = findTopLevel(inner, 0, ",");
+
+    left = inner.substr(0, comma);
+    right = (comma == std::string_view::npos ? std::string_view() : inner.substr(comma + 1));
+  }
+  else if (!args.empty() && (args[0] == '"' || args[0] == '\'')) {
+    size_t end = args.find(args[0], 1);
+
+    left = args.substr(1, end == std::string_view::npos ? std::string_view::npos : end - 1);
+    args = (end == std::string_view::npos ? std::string_view() : trim(args.substr(end + 1)));
+    if (!args.empty() && (args[0] == '"' || args[0] == '\'')) {
+      end = args.find(args[0], 1);
+      right = args.substr(1, end == std::string_view::npos ? std::string_view::npos : end - 1);
+    }
+  }
+  std::string expandedLeft = expander.expand(left);
+  std::string expandedRight = expander.expand(right);
+
+  return (trim(expandedLeft) == trim(expandedRight)) == (directive == "ifeq");
+}
+
+void Makefile::_extractVariable(std::string_view name)
+{
+  Variable variable = {};
+
+  this->_generation++;
+  this->_variables.erase(name);
+  if (this->_replay(name, SIZE_MAX, variable, this->_arena)) {
+    variable.generation = this->_generation;
+    this->_variables.emplace(name, variable);
   }
+  auto occurrences = this->_occurrences.find(name);
+
+  if (occurrences != this->_occurrences.end() && occurrences->second.empty())
+    this->_occurrences.erase(occurrences);
 }
 
-void Makefile::_extractVariableModifiers()
+bool Makefile::variableAt(std::string_view name, size_t line, Variable &variable, Arena &arena) const
 {
-  for (const std::string &line: this->_makefile) {
-    if (this->_isVariableModifier(line)) {
-      int found = line.find("+=");
-      int equalPos = found + 1;
-      std::string name(line, 0, found);
-      std::string addedContent(line, equalPos + 1);
+  return this->_replay(name, line, variable, arena);
+}
+
+bool Makefile::_replay(std::string_view name, size_t limit, Variable &variable, Arena &arena) const
+{
+  auto occurrences = this->_occurrences.find(name);
+  std::vector<uint32_t> scanned;
+  std::string modified;
+  bool defined = false;
+  bool isModified = false;
+
+  if (!this->_indexed) {
+    for (size_t i = 0; i < this->_makefile.size() && i < limit; i++) {
+      const Line &line = this->_makefile[i];
 
-      epur(name);
-      epur(addedContent);
-      this->_variables[name] += addedContent;
+      if ((line.kind == Line::Variable || line.kind == Line::VariableModifier) && storeEpured(line.name(), arena) == name)
+        scanned.push_back(i);
     }
   }
+  else if (occurrences == this->_occurrences.end())
+    return false;
+  for (uint32_t index: (this->_indexed ? occurrences->second : scanned)) {
+    if (index >= limit)
+      break;
+    const Line &line = this->_makefile[index];
+
+    if (!line.active || (line.kind != Line::Variable && line.kind != Line::VariableModifier))
+      continue;
+    std::string_view content = (line.multiline ? line.value() : storeEpured(line.value(), arena));
+    bool simple = (line.kind == Line::Variable ? line.op == ':' : defined && variable.flavor == Variable::Simple);
+
+    if (simple && content.find('$') != std::string_view::npos)
+      content = this->_siteValue(index);
+    if (line.kind == Line::VariableModifier && defined) {
+      if (!isModified)
+        modified = variable.value;
+      isModified = true;
+      if (!modified.empty() && !content.empty())
+        modified += ' ';
+      modified += content;
+    }
+    else if (!defined) {
+      variable = Variable{content, line.lineno, flavorOf(line.op), 0};
+      defined = true;
+    }
+    else if (line.op != '?') {
+      variable.value = content;
+      variable.flavor = flavorOf(line.op);
+      isModified = false;
+    }
+  }
+  if (isModified)
+    variable.value = arena.store(modified);
+  return defined;
 }
 
+std::string_view Makefile::_siteValue(size_t line) const
+{
+  auto before = [](const Site &site, size_t index) { return site.line < index; };
+  auto found = std::lower_bound(this->_sites.begin(), this->_sites.end(), line, before);
+
+  return (found != this->_sites.end() && found->line == line ? found->value : std::string_view());
+}
 
 void Makefile::_extractReceipes()
 {
-  for (auto it = this->_makefile.begin(); it != this->_makefile.end(); it++) {
-    if (this->_isReceipeTarget(*it)) {
-      int foundColon = it->find(":");
-      int foundSemicolon = it->find(";");
-      Receipe receipe;
-      
-      receipe.target = std::string(*it, 0, foundColon);
-      epur(receipe.target);
-      if (it->begin() + foundColon + 1 != it->end()) {
-        if (foundSemicolon != -1)
-          receipe.deps = std::string(*it, foundColon + 1, foundSemicolon - foundColon - 1);
-        else {
-          receipe.deps = std::string(*it, foundColon + 1);
-        }
-        epur(receipe.deps);
+  this->_receipes.reserve(this->_counts[Line::ReceipeTarget]);
+  this->_cmds.reserve(this->_counts[Line::ReceipeTarget] + this->_counts[Line::ReceipeCommand]);
+  this->_collectReceipes(0, this->_makefile.size(), this->_receipes, this->_cmds);
+}
+
+void Makefile::_collectReceipes(size_t first, size_t last, std::pmr::vector<Receipe> &receipes, std::pmr::vector<std::string_view> &cmds)
+{
+  auto end = this->_makefile.begin() + last;
+
+  for (auto it = this->_makefile.begin() + first; it != end; it++) {
+    if (it->kind == Line::ReceipeTarget && it->active) {
+      Receipe receipe = {this->_arena.intern(this->_epur(it->name())), std::string_view(), this->_epur(it->value()), static_cast<uint32_t>(cmds.size()), 0, it->lineno};
+      size_t colon = findTopLevel(receipe.deps, 0, ":");
+
+      if (colon != std::string_view::npos && (colon + 1 == receipe.deps.size() || receipe.deps[colon + 1] != '=')) {
+        receipe.pattern = trim(receipe.deps.substr(0, colon));
+        receipe.deps = trim(receipe.deps.substr(colon + 1));
       }
-      if (foundSemicolon != -1) {
-        receipe.cmds.push_back(std::string(*it, foundSemicolon + 1));
-        epur(receipe.cmds.back());
+
+      if (it->valueEnd < it->text.size()) {
+        cmds.push_back(this->_epur(it->text.substr(it->valueEnd + 1)));
+        receipe.cmdCount++;
       }
-      if (std::next(it) != this->_makefile.end() && this->_isReceipeCommand(*(std::next(it)))) {
+      while (std::next(it) != end && (std::next(it)->kind == Line::ReceipeCommand || (this->_conditionals > 0 && this->_isBranching(*std::next(it))))) {
         it++;
-        while (it != this->_makefile.end() && this->_isReceipeCommand(*it)) {
-          receipe.cmds.push_back(*it);
-          epur(receipe.cmds.back());
-          it++;
+        if (it->kind == Line::ReceipeCommand && it->active) {
+          cmds.push_back(this->_epur(it->value()));
+          receipe.cmdCount++;
         }
-        it--;
       }
-      this->_receipes.push_back(receipe);
+      receipes.push_back(receipe);
     }
   }
 }
 
 void Makefile::_extractPhony()
 {
-  auto phony = std::find_if(this->_receipes.begin(), this->_receipes.end(), [](const Receipe &r) -> bool { return r.target == ".PHONY";});
+  auto isPhony = [](const Receipe &receipe) -> bool { return receipe.target == ".PHONY"; };
+
+  for (const Receipe &receipe: this->_receipes) {
+    if (isPhony(receipe))
+      this->_phonies.push_back(receipe);
+  }
+  this->_receipes.erase(std::remove_if(this->_receipes.begin(), this->_receipes.end(), isPhony), this->_receipes.end());
+  this->_joinPhony();
+}
+
+void Makefile::_joinPhony()
+{
+  std::string phony;
+  size_t count = 0;
+
+  this->_phony = std::string_view();
+  for (const Receipe &receipe: this->_phonies) {
+    if (receipe.deps.empty())
+      continue;
+    if (count++ == 0)
+      this->_phony = receipe.deps;
+    else {
+      if (phony.empty())
+        phony = this->_phony;
+      phony += " ";
+      phony += receipe.deps;
+    }
+  }
+  if (count > 1)
+    this->_phony = this->_arena.store(phony);
+}
+
+void Makefile::_collectScopes(size_t first, size_t last, std::pmr::vector<Scope> &scopes)
+{
+  for (size_t i = first; i < last; i++) {
+    const Line &line = this->_makefile[i];
+
+    if (line.kind != Line::TargetVariable || !line.active)
+      continue;
+    std::string_view target = this->_epur(line.text.substr(0, findTopLevel(line.text, 0, ":")));
+
+    scopes.push_back({target, this->_variableName(line), this->_epur(line.value()), line.lineno, line.op});
+  }
+}
+
+std::string_view Makefile::_variableName(const Line &line)
+{
+  return this->_arena.intern(this->_epur(line.name()));
+}
+
+template <typename Vector, typename Items>
+static void splice(Vector &vector, size_t pos, size_t count, const Items &items)
+{
+  size_t common = std::min(count, static_cast<size_t>(items.size()));
+
+  std::copy(items.begin(), items.begin() + common, vector.begin() + pos);
+  if (count > common)
+    vector.erase(vector.begin() + pos + common, vector.begin() + pos + count);
+  else
+    vector.insert(vector.begin() + pos + common, items.begin() + common, items.end());
+}
+
+static bool isTerminator(std::string_view line)
+{
+  if (!line.empty() && line.back() == '\n')
+    line.remove_suffix(1);
+  return !line.empty() && line[0] != '#' && line.back() != '\\';
+}
+
+size_t Makefile::_enclosing(size_t line, size_t &depth, size_t &choices) const
+{
+  size_t outer = line;
+
+  depth = 0;
+  choices = 0;
+  for (const Site &site: this->_sites) {
+    if (site.line >= line)
+      break;
+    const Line &branch = this->_makefile[site.line];
+
+    if (branch.kind != Line::Directive)
+      continue;
+    if (isConditional(branch.name())) {
+      if (depth++ == 0)
+        outer = site.line;
+      choices++;
+    }
+    else if (branch.name() == "endif" && depth > 0)
+      depth--;
+  }
+  return (depth > 0 ? outer : line);
+}
+
+size_t Makefile::_blockEnd(size_t line) const
+{
+  auto before = [](const Site &site, size_t index) { return site.line < index; };
+  size_t depth;
+  size_t choices;
+
+  this->_enclosing(line, depth, choices);
+  for (auto site = std::lower_bound(this->_sites.begin(), this->_sites.end(), line, before); depth > 0 && site != this->_sites.end(); site++) {
+    const Line &branch = this->_makefile[site->line];
+
+    if (branch.kind != Line::Directive)
+      continue;
+    if (isConditional(branch.name()))
+      depth++;
+    else if (branch.name() == "endif" && --depth == 0)
+      return site->line + 1;
+  }
+  return (depth > 0 ? this->_makefile.size() : line);
+}
+
+bool Makefile::_depends(std::string_view text, Revision &revision) const
+{
+  return Expander::references(text, [this, &revision](std::string_view name) {
+    auto occurrences = this->_occurrences.find(name);
+    bool affected = false;
+
+    if (std::binary_search(revision.names.begin(), revision.names.end(), name))
+      return true;
+    auto known = revision.affected.find(name);
+
+    if (known != revision.affected.end())
+      return known->second;
+    known = revision.affected.emplace(name, false).first;
+    for (size_t i = 0; occurrences != this->_occurrences.end() && i < occurrences->second.size() && !affected; i++)
+      affected = this->_depends(this->_makefile[occurrences->second[i]].value(), revision);
+    for (auto fragment = this->_included.begin(); fragment != this->_included.end() && !affected; fragment++) {
+      auto variable = (*fragment)->variables().find(name);
+
+      if (variable != (*fragment)->variables().end() && variable->second.flavor != Variable::Simple)
+        affected = this->_depends(variable->second.value, revision);
+    }
+    known->second = affected;
+    return affected;
+  });
+}
+
+void Makefile::_touch(std::string_view name, Revision &revision) const
+{
+  auto found = std::lower_bound(revision.names.begin(), revision.names.end(), name);
+
+  if (found != revision.names.end() && *found == name)
+    return;
+  revision.names.insert(found, name);
+  revision.affected.clear();
+}
+
+void Makefile::_revise(Site &site, bool force, Revision &revision)
+{
+  const Line &line = this->_makefile[site.line];
+  std::string_view name = this->_variableName(line);
+  std::string_view content;
+  Variable variable = {};
+  std::string expanded;
 
-  if (phony == this->_receipes.end() && phony->target != ".PHONY")
+  if (!force && !std::binary_search(revision.names.begin(), revision.names.end(), name) && !this->_depends(line.value(), revision))
     return;
-  this->_phony = phony->deps;
-  erase(this->_receipes, phony);
+  content = (line.multiline ? line.value() : this->_epur(line.value()));
+  if (line.kind == Line::Variable || (this->_replay(name, site.line, variable, this->_arena) && variable.flavor == Variable::Simple)) {
+    Expander expander(*this, static_cast<size_t>(site.line));
+
+    expanded = expander.expand(content);
+    this->_expansions++;
+  }
+  if (expanded == site.value)
+    return;
+  site.value = this->_arena.store(expanded);
+  this->_touch(name, revision);
+}
+
+size_t Makefile::_rewalk(size_t start, size_t bound, std::vector<uint32_t> &branches, Revision &revision)
+{
+  struct Branch {
+    bool parent;
+    bool active;
+    bool taken;
+    bool otherwise;
+    uint32_t choice;
+    uint32_t arm;
+  };
+  auto before = [](const Site &site, size_t index) { return site.line < index; };
+  auto site = std::lower_bound(this->_sites.begin(), this->_sites.end(), start, before);
+  std::vector<Branch> stack;
+  bool active = true;
+  size_t i;
+  auto decide = [this, &stack, &i](std::string_view directive, std::string_view args) {
+    Branch &branch = stack.back();
+    bool condition;
+
+    if (!branch.parent || branch.taken)
+      condition = false;
+    else if (directive.empty())
+      condition = true;
+    else {
+      Expander expander(*this, i);
+
+      condition = this->_condition(directive, args, expander);
+    }
+    branch.active = condition;
+    branch.taken = branch.taken || condition;
+  };
+
+  for (i = start; i < this->_makefile.size() && (i < bound || !stack.empty()); i++) {
+    Line &line = this->_makefile[i];
+    bool fresh = (i >= revision.first && i < revision.last) || line.active != active;
+
+    line.active = active;
+    while (site != this->_sites.end() && site->line < i)
+      site++;
+    if (this->_isBranch(line)) {
+      std::string_view directive = line.name();
+
+      if (isConditional(directive)) {
+        stack.push_back({active, false, false, false, static_cast<uint32_t>(branches.size()), 0});
+        branches.push_back(1);
+        decide(directive, line.value());
+      }
+      else if (directive == "else" && !stack.empty()) {
+        std::string_view rest = line.value();
+        std::string_view word = firstWord(rest, 0);
+
+        stack.back().arm++;
+        branches[stack.back().choice] = stack.back().arm + 1;
+        if (isConditional(word))
+          decide(word, rest.substr(skipSpaces(rest, word.size())));
+        else {
+          stack.back().otherwise = true;
+          decide(std::string_view(), std::string_view());
+        }
+      }
+      else if (directive == "endif" && !stack.empty()) {
+        if (!stack.back().otherwise)
+          branches[stack.back().choice]++;
+        stack.pop_back();
+      }
+      active = (stack.empty() || stack.back().active);
+      continue;
+    }
+    if (line.kind != Line::Variable && line.kind != Line::VariableModifier)
+      continue;
+    if (fresh)
+      this->_touch(this->_variableName(line), revision);
+    if (line.active && site != this->_sites.end() && site->line == i)
+      this->_revise(*site, fresh, revision);
+  }
+  return i;
+}
+
+void Makefile::_propagate(size_t position, Revision &revision, std::vector<std::pair<size_t, size_t>> &dirty)
+{
+  auto before = [](const Site &site, size_t index) { return site.line < index; };
+  auto site = std::lower_bound(this->_sites.begin(), this->_sites.end(), position, before);
+  size_t depth;
+  size_t choices;
+  size_t outer = this->_enclosing(position, depth, choices);
+
+  while (!revision.names.empty() && site != this->_sites.end()) {
+    const Line &line = this->_makefile[site->line];
+    std::string_view directive = line.name();
+    std::string_view args = line.value();
+    std::vector<uint32_t> branches;
+    std::string wrapped;
+    size_t end;
+
+    if (line.kind != Line::Directive) {
+      if (line.active)
+        this->_revise(*site, false, revision);
+      site++;
+      continue;
+    }
+    if (isConditional(directive)) {
+      if (depth++ == 0)
+        outer = site->line;
+    }
+    else if (directive == "else") {
+      directive = firstWord(args, 0);
+      args = args.substr(skipSpaces(args, directive.size()));
+    }
+    else if (directive == "endif" && depth > 0)
+      depth--;
+    if (directive == "ifdef" || directive == "ifndef") {
+      wrapped = "$(" + std::string(trim(args)) + ")";
+      args = wrapped;
+    }
+    if (depth == 0 || !isConditional(directive) || !this->_depends(args, revision)) {
+      site++;
+      continue;
+    }
+    this->_enclosing(outer, depth, choices);
+    end = this->_rewalk(outer, outer + 1, branches, revision);
+    std::copy(branches.begin(), branches.end(), this->_branches.begin() + choices);
+    dirty.emplace_back(outer, end);
+    depth = 0;
+    site = std::lower_bound(site, this->_sites.end(), end, before);
+  }
+}
+
+void Makefile::_recollect(size_t first, size_t last, uint32_t from)
+{
+  std::pmr::vector<Receipe> receipes;
+  std::pmr::vector<Receipe> phonies;
+  std::pmr::vector<Scope> scopes;
+  std::pmr::vector<std::string_view> cmds;
+  auto byLine = [](const Receipe &receipe, uint32_t line) { return receipe.line < line; };
+  auto byScope = [](const Scope &scope, uint32_t line) { return scope.line < line; };
+  uint32_t to = (last < this->_makefile.size() ? this->_makefile[last].lineno : UINT32_MAX);
+  size_t r0 = std::lower_bound(this->_receipes.begin(), this->_receipes.end(), from, byLine) - this->_receipes.begin();
+  size_t r1 = std::lower_bound(this->_receipes.begin() + r0, this->_receipes.end(), to, byLine) - this->_receipes.begin();
+  size_t p0 = std::lower_bound(this->_phonies.begin(), this->_phonies.end(), from, byLine) - this->_phonies.begin();
+  size_t p1 = std::lower_bound(this->_phonies.begin() + p0, this->_phonies.end(), to, byLine) - this->_phonies.begin();
+  size_t s0 = std::lower_bound(this->_scopes.begin(), this->_scopes.end(), from, byScope) - this->_scopes.begin();
+  size_t s1 = std::lower_bound(this->_scopes.begin() + s0, this->_scopes.end(), to, byScope) - this->_scopes.begin();
+  size_t c0 = (r0 < this->_receipes.size() ? this->_receipes[r0].firstCmd : this->_cmds.size());
+  size_t c1 = (r1 > r0 ? this->_receipes[r1 - 1].firstCmd + this->_receipes[r1 - 1].cmdCount : c0);
+
+  this->_collectReceipes(first, last, receipes, cmds);
+  for (auto it = receipes.begin(); it != receipes.end();) {
+    it->firstCmd += c0;
+    if (it->target == ".PHONY") {
+      phonies.push_back(*it);
+      it = receipes.erase(it);
+    }
+    else
+      it++;
+  }
+  if (cmds.size() != c1 - c0) {
+    for (size_t i = r1; i < this->_receipes.size(); i++)
+      this->_receipes[i].firstCmd += static_cast<int64_t>(cmds.size()) - static_cast<int64_t>(c1 - c0);
+  }
+  splice(this->_cmds, c0, c1 - c0, cmds);
+  splice(this->_receipes, r0, r1 - r0, receipes);
+  if (p1 > p0 || !phonies.empty()) {
+    splice(this->_phonies, p0, p1 - p0, phonies);
+    this->_joinPhony();
+  }
+  this->_collectScopes(first, last, scopes);
+  splice(this->_scopes, s0, s1 - s0, scopes);
+  this->_edited += cmds.size() * sizeof(std::string_view) + receipes.size() * sizeof(Receipe) + scopes.size() * sizeof(Scope);
+}
+
+void Makefile::edit(size_t offset, size_t length, std::string_view replacement)
+{
+  std::pmr::vector<Line> lines;
+  std::vector<std::string_view> pieces;
+  std::vector<std::string_view> names;
+  std::vector<std::pair<size_t, size_t>> dirty;
+  std::vector<uint32_t> branches;
+  std::vector<Site> sites;
+  std::string text;
+  size_t first;
+  size_t last;
+  bool conditional;
+
+  this->_indexLines();
+  conditional = (this->_conditionals > 0);
+  if (offset > this->_size || length > this->_size - offset) {
+    throw MakefileException("Invalid edit range for " + this->_makefilePath);
+  }
+  if (this->_lines.empty() || this->_recipePrefixes > 0 || !this->_forced.empty()) {
+    text = this->_text();
+    text.replace(offset, length, replacement);
+    this->_rebuild(std::move(text));
+    return;
+  }
+  first = this->_lineAt(offset);
+  last = this->_lineAt(offset + length);
+  text.append(this->_lines[first].substr(0, offset - this->_offsets[first]));
+  text.append(replacement);
+  text.append(this->_lines[last].substr(offset + length - this->_offsets[last]));
+  while (last + 1 < this->_lines.size() && (text.empty() || text.back() != '\n'))
+    text.append(this->_lines[++last]);
+
+  std::string_view stored = this->_arena.store(text);
+
+  for (size_t pos = 0; pos < stored.size();) {
+    size_t eol = stored.find('\n', pos);
+    size_t end = (eol == std::string_view::npos ? stored.size() : eol + 1);
+
+    pieces.push_back(stored.substr(pos, end - pos));
+    pos = end;
+  }
+
+  size_t staleBegin = this->_logicalAt(first);
+  size_t staleEnd = this->_logicalAt(last + 1);
+  int64_t delta = static_cast<int64_t>(pieces.size()) - static_cast<int64_t>(last - first + 1);
+  auto relocate = [first, last, delta](uint32_t &lineno) {
+    if (lineno > last + 1)
+      lineno += delta;
+    else if (lineno > first + 1)
+      lineno = first + 1;
+  };
+
+  int64_t growth = static_cast<int64_t>(replacement.size()) - static_cast<int64_t>(length);
+
+  splice(this->_lines, first, last - first + 1, pieces);
+  splice(this->_offsets, first, last - first + 1, std::vector<size_t>(pieces.size(), this->_offsets[first]));
+  for (size_t i = first + 1; i < first + pieces.size(); i++)
+    this->_offsets[i] = this->_offsets[i - 1] + this->_lines[i - 1].size();
+  for (size_t i = first + pieces.size(); i < this->_offsets.size(); i++)
+    this->_offsets[i] += growth;
+  this->_size = this->_size - length + replacement.size();
+  if (delta != 0 || last != first) {
+    auto byLine = [](const Receipe &receipe, uint32_t line) { return receipe.line < line; };
+    auto byScope = [](const Scope &scope, uint32_t line) { return scope.line < line; };
+
+    for (size_t i = staleBegin; i < this->_makefile.size(); i++)
+      relocate(this->_makefile[i].lineno);
+    for (auto it = std::lower_bound(this->_receipes.begin(), this->_receipes.end(), first + 2, byLine); it != this->_receipes.end(); it++)
+      relocate(it->line);
+    for (auto it = std::lower_bound(this->_phonies.begin(), this->_phonies.end(), first + 2, byLine); it != this->_phonies.end(); it++)
+      relocate(it->line);
+    for (auto it = std::lower_bound(this->_scopes.begin(), this->_scopes.end(), first + 2, byScope); it != this->_scopes.end(); it++)
+      relocate(it->line);
+    for (auto &[name, variable]: this->_variables)
+      relocate(variable.line);
+  }
+
+  size_t begin = first;
+  size_t end = first + pieces.size();
+  size_t a;
+  size_t b;
+
+  while (begin > 0 && !isTerminator(this->_lines[begin - 1]))
+    begin--;
+  a = this->_logicalAt(begin);
+  if (a > 0 && this->_makefile[a - 1].multiline)
+    a--;
+  while (a > 0 && this->_makefile[a - 1].kind == Line::ReceipeCommand)
+    a--;
+  if (a > 0 && this->_makefile[a - 1].kind == Line::ReceipeTarget)
+    a--;
+  if (a < this->_makefile.size())
+    begin = std::min<size_t>(begin, this->_makefile[a].lineno - 1);
+  b = std::max(this->_logicalAt(end), staleEnd);
+  for (;;) {
+    while (b < this->_makefile.size() && this->_makefile[b].kind == Line::ReceipeCommand)
+      b++;
+    end = std::max<size_t>(end, b < this->_makefile.size() ? this->_makefile[b].lineno - 1 : this->_lines.size());
+    if (end == begin || end == this->_lines.size() || isTerminator(this->_lines[end - 1]))
+      break;
+    b = std::max(b, this->_logicalAt(++end));
+  }
+
+  if (!this->_cleanLines(begin, end, lines) || this->_recipePrefixes > 0) {
+    this->_rebuild(this->_text());
+    return;
+  }
+
+  int64_t shift = static_cast<int64_t>(lines.size()) - static_cast<int64_t>(b - a);
+  auto before = [](const Site &site, size_t index) { return site.line < index; };
+  size_t firstSite = std::lower_bound(this->_sites.begin(), this->_sites.end(), a, before) - this->_sites.begin();
+  size_t lastSite = std::lower_bound(this->_sites.begin() + firstSite, this->_sites.end(), b, before) - this->_sites.begin();
+  size_t depth;
+  size_t choices;
+  size_t start = this->_enclosing(a, depth, choices);
+  size_t bound = 0;
+  size_t replaced = 0;
+  bool walk = (depth > 0 && b == this->_makefile.size());
+  bool active = (depth == 0 || (b < this->_makefile.size() && this->_makefile[b].active));
+
+  for (size_t i = a; i < b && !walk; i++)
+    walk = this->_isBranch(this->_makefile[i]);
+  for (size_t i = 0; i < lines.size() && !walk; i++)
+    walk = this->_isBranch(lines[i]);
+  if (walk) {
+    bound = this->_blockEnd(b);
+    this->_enclosing(bound, depth, replaced);
+    this->_enclosing(start, depth, choices);
+    replaced -= choices;
+    bound += shift;
+  }
+
+  for (size_t i = a; i < b; i++) {
+    this->_counts[this->_makefile[i].kind]--;
+    if (this->_makefile[i].kind == Line::Directive && isConditional(this->_makefile[i].name()))
+      this->_conditionals--;
+    if (this->_makefile[i].kind == Line::Variable || this->_makefile[i].kind == Line::VariableModifier)
+      names.push_back(this->_variableName(this->_makefile[i]));
+  }
+  if ((this->_conditionals > 0) != conditional) {
+    this->_rebuild(this->_text());
+    return;
+  }
+  auto unlink = [a, b, shift](std::vector<uint32_t> &indices) {
+    auto low = std::lower_bound(indices.begin(), indices.end(), a);
+    auto high = std::lower_bound(indices.begin(), indices.end(), b);
+
+    for (auto it = high; it != indices.end() && shift != 0; it++)
+      *it += shift;
+    indices.erase(low, high);
+  };
+  if (shift != 0) {
+    for (auto &[name, indices]: this->_occurrences)
+      unlink(indices);
+    for (size_t i = lastSite; i < this->_sites.size(); i++)
+      this->_sites[i].line += shift;
+  }
+  else {
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (std::string_view name: names)
+      unlink(this->_occurrences[name]);
+  }
+  splice(this->_makefile, a, b - a, lines);
+  for (size_t i = 0; i < lines.size(); i++) {
+    Line &line = this->_makefile[a + i];
+
+    line.active = active;
+    if (this->_isBranch(line) || this->_isEager(line))
+      sites.push_back({static_cast<uint32_t>(a + i), std::string_view()});
+    if (line.kind == Line::Variable || line.kind == Line::VariableModifier) {
+      std::string_view name = this->_variableName(line);
+      std::vector<uint32_t> &indices = this->_occurrences[name];
+
+      indices.insert(std::lower_bound(indices.begin(), indices.end(), a + i), a + i);
+      names.push_back(name);
+    }
+  }
+  splice(this->_sites, firstSite, lastSite - firstSite, sites);
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+
+  Revision revision = {names, {}, a, a + lines.size()};
+  size_t position = a + lines.size();
+
+  dirty.emplace_back(a, a + lines.size());
+  if (walk) {
+    size_t tail;
+    size_t after;
+
+    position = this->_rewalk(start, bound, branches, revision);
+    this->_enclosing(bound, depth, tail);
+    this->_enclosing(position, depth, after);
+    splice(this->_branches, choices, replaced + after - tail, branches);
+    dirty.emplace_back(start, position);
+  }
+  else {
+    for (size_t i = firstSite; i < firstSite + sites.size(); i++) {
+      if (!this->_isBranch(this->_makefile[this->_sites[i].line]) && active)
+        this->_revise(this->_sites[i], true, revision);
+    }
+  }
+  this->_propagate(position, revision, dirty);
+  for (std::string_view name: revision.names)
+    this->_extractVariable(name);
+  for (auto &range: dirty) {
+    while (range.first > 0 && (this->_makefile[range.first - 1].kind == Line::ReceipeCommand || this->_isBranching(this->_makefile[range.first - 1])))
+      range.first--;
+    if (range.first > 0 && this->_makefile[range.first - 1].kind == Line::ReceipeTarget)
+      range.first--;
+    while (range.second < this->_makefile.size() && (this->_makefile[range.second].kind == Line::ReceipeCommand || this->_isBranching(this->_makefile[range.second])))
+      range.second++;
+  }
+  std::sort(dirty.begin(), dirty.end());
+  for (size_t i = 0; i < dirty.size(); i++) {
+    size_t lower = dirty[i].first;
+    size_t upper = dirty[i].second;
+    uint32_t from = (lower < this->_makefile.size() ? this->_makefile[lower].lineno : UINT32_MAX);
+
+    while (i + 1 < dirty.size() && dirty[i + 1].first <= upper)
+      upper = std::max(upper, dirty[++i].second);
+    if (lower <= a && a <= upper)
+      from = std::min<uint32_t>(from, begin + 1);
+    this->_recollect(lower, upper, from);
+  }
+  this->_edited += stored.size() + lines.size() * sizeof(Line);
+  if (this->_edited > this->_size + 65536)
+    this->_rebuild(this->_text());
+}
+
+void Makefile::update(std::string_view content)
+{
+  size_t prefix = 0;
+  size_t suffix = 0;
+  size_t limit;
+
+  this->_indexLines();
+  for (std::string_view line: this->_lines) {
+    size_t common = 0;
+
+    limit = std::min(line.size(), content.size() - prefix);
+    if (limit == line.size() && content.compare(prefix, limit, line) == 0)
+      common = limit;
+    else {
+      while (common < limit && line[common] == content[prefix + common])
+        common++;
+    }
+    prefix += common;
+    if (common < line.size())
+      break;
+  }
+  limit = std::min(this->_size, content.size()) - prefix;
+  for (auto it = this->_lines.rbegin(); it != this->_lines.rend() && suffix < limit; it++) {
+    size_t common = 0;
+    size_t size = std::min(it->size(), limit - suffix);
+
+    while (common < size && (*it)[it->size() - 1 - common] == content[content.size() - 1 - suffix - common])
+      common++;
+    suffix += common;
+    if (common < it->size())
+      break;
+  }
+  if (prefix + suffix == this->_size && this->_size == content.size())
+    return;
+  this->edit(prefix, this->_size - prefix - suffix, content.substr(prefix, content.size() - prefix - suffix));
+}
+
+void Makefile::_indexLines()
+{
+  std::string_view content = (this->_file.data() != nullptr ? this->_file.view() : std::string_view(this->_content));
+
+  if (this->_indexed)
+    return;
+  this->_lines.clear();
+  this->_offsets.clear();
+  this->_occurrences.clear();
+  for (size_t pos = 0; pos < content.size();) {
+    size_t eol = content.find('\n', pos);
+    size_t end = (eol == std::string_view::npos ? content.size() : eol + 1);
+
+    this->_offsets.push_back(pos);
+    this->_lines.push_back(content.substr(pos, end - pos));
+    pos = end;
+  }
+  for (size_t i = 0; i < this->_makefile.size(); i++) {
+    if (this->_makefile[i].kind == Line::Variable || this->_makefile[i].kind == Line::VariableModifier)
+      this->_occurrences[this->_variableName(this->_makefile[i])].push_back(i);
+  }
+  this->_size = content.size();
+  this->_indexed = true;
+}
+
+size_t Makefile::_lineAt(size_t offset) const
+{
+  size_t line = std::upper_bound(this->_offsets.begin(), this->_offsets.end(), offset) - this->_offsets.begin();
+
+  return std::min(line, this->_offsets.size()) - 1;
+}
+
+size_t Makefile::_logicalAt(size_t line) const
+{
+  auto before = [](const Line &logical, size_t physical) { return logical.lineno < physical + 1; };
+
+  return std::lower_bound(this->_makefile.begin(), this->_makefile.end(), line, before) - this->_makefile.begin();
+}
+
+std::string Makefile::_text() const
+{
+  std::string text;
+
+  text.reserve(this->_size);
+  for (std::string_view line: this->_lines)
+    text.append(line);
+  return text;
+}
+
+void Makefile::_rebuild(std::string &&content)
+{
+  std::pmr::memory_resource *resource = this->_arena.resource();
+
+  this->_content = std::move(content);
+  this->_file = MappedFile();
+  Variables(resource).swap(this->_variables);
+  std::pmr::vector<Receipe>(resource).swap(this->_receipes);
+  std::pmr::vector<std::string_view>(resource).swap(this->_cmds);
+  std::pmr::vector<Line>(resource).swap(this->_makefile);
+  std::pmr::vector<Receipe>(resource).swap(this->_phonies);
+  std::pmr::vector<Scope>(resource).swap(this->_scopes);
+  this->_arena.release();
+  std::fill(std::begin(this->_counts), std::end(this->_counts), 0);
+  this->_recipePrefix = '\t';
+  this->_recipePrefixes = 0;
+  this->_conditionals = 0;
+  this->_phony = std::string_view();
+  this->_lines.clear();
+  this->_offsets.clear();
+  this->_occurrences.clear();
+  this->_edited = 0;
+  this->_indexed = false;
+  this->_parse(this->_content);
+}
+
+const std::string &Makefile::getPath() const
+{
+  return this->_makefilePath;
+}
+
+Span<Makefile::Receipe> Makefile::receipes() const
+{
+  return Span<Receipe>(this->_receipes.data(), this->_receipes.size());
+}
+
+Span<Makefile::Scope> Makefile::scopes() const
+{
+  return Span<Scope>(this->_scopes.data(), this->_scopes.size());
+}
+
+Span<std::string_view> Makefile::commands(const Receipe &receipe) const
+{
+  return Span<std::string_view>(this->_cmds.data() + receipe.firstCmd, receipe.cmdCount);
+}
+
+const Makefile::Variables &Makefile::variables() const
+{
+  return this->_variables;
+}
+
+uint32_t Makefile::generation() const
+{
+  return this->_generation;
+}
+
+Words Makefile::phony() const
+{
+  return Words(this->_phony);
+}
+
+std::vector<Makefile::Include> Makefile::includes() const
+{
+  std::vector<Include> includes;
+
+  for (const Line &line: this->_makefile) {
+    if (line.kind != Line::Directive || !line.active)
+      continue;
+    std::string_view directive = line.name();
+
+    if (directive == "include" || directive == "-include" || directive == "sinclude")
+      includes.push_back({line.value(), line.lineno, directive != "include"});
+  }
+  return includes;
+}
+
+void Makefile::resolveIncludes(IncludeCache &cache)
+{
+  this->_included = cache.resolve(*this, this->_dependencies);
+  if ((this->_conditionals > 0 || this->_expansions > 0) && !this->_included.empty())
+    this->_extract();
+}
+
+const std::vector<std::shared_ptr<const Makefile>> &Makefile::included() const
+{
+  return this->_included;
+}
+
+const std::vector<std::string> &Makefile::dependencies() const
+{
+  return this->_dependencies;
+}
+
+const std::vector<uint32_t> &Makefile::branches() const
+{
+  return this->_branches;
+}
+
+void Makefile::select(const std::vector<uint32_t> &arms)
+{
+  this->_forced = arms;
+  this->_extract();
 }
 
 const std::string Makefile::getMakefile() const
@@ -201,7 +1513,7 @@ const std::string Makefile::getMakefile() const
   std::string out;
   
   for (auto it = this->_makefile.begin(); it != this->_makefile.end(); it++) {
-    out += *it;
+    out += it->text;
     if (std::next(it) != this->_makefile.end())
       out += "\n";
   }
@@ -213,26 +1525,80 @@ const std::string Makefile::getVariables() const
   std::string out;
 
   for (auto it = this->_variables.begin(); it != this->_variables.end(); it++) {
-    out += ("[" + it->first + "] = '" + it->second + "'");
+    out += "[";
+    out += it->first;
+    out += "] = '";
+    out += it->second.value;
+    out += "'";
     if (std::next(it) != this->_variables.end())
       out += "\n";
   }
   return out;
 }
 
+const std::string Makefile::getTargetVariables() const
+{
+  std::unique_ptr<Expander> expander;
+  std::vector<std::string> targets;
+  std::string out;
+
+  for (const Scope &scope: this->_scopes) {
+    std::string expanded(scope.target);
+
+    if (expanded.find('$') != std::string::npos) {
+      if (expander == nullptr)
+        expander = std::make_unique<Expander>(*this);
+      expanded = expander->expand(scope.target);
+    }
+    for (std::string_view target: Words(expanded)) {
+      if (std::find(targets.begin(), targets.end(), target) == targets.end())
+        targets.emplace_back(target);
+    }
+  }
+  for (const std::string &target: targets) {
+    Overlay overlay(*this, target);
+
+    if (!out.empty())
+      out += "\n";
+    out += "target = '";
+    out += target;
+    out += "'";
+    for (const auto &[name, variable]: overlay.variables()) {
+      out += "\n[";
+      out += name;
+      out += "] = '";
+      out += variable.value;
+      out += "'";
+    }
+  }
+  return out;
+}
+
 const std::string Makefile::getReceipes() const
 {
   std::string out;
 
   for (auto it = this->_receipes.begin(); it != this->_receipes.end(); it++) {
-    out += ("target = '" + it->target + "'");
-    if (!it->deps.empty())
-      out += ("\ndeps = '" + it->deps+ "'");
-    if (!it->cmds.empty()) {
+    out += "target = '";
+    out += it->target;
+    out += "'";
+    if (!it->pattern.empty()) {
+      out += "\npattern = '";
+      out += it->pattern;
+      out += "'";
+    }
+    if (!it->deps.empty()) {
+      out += "\ndeps = '";
+      out += it->deps;
+      out += "'";
+    }
+    if (it->cmdCount > 0) {
       out += "\ncommands:\n";
-      for (auto it2 = it->cmds.begin(); it2 != it->cmds.end(); it2++) {
-	out += (" - '" + *it2 + "'");
-	if (std::next(it2) != it->cmds.end())
+      for (uint32_t i = it->firstCmd; i < it->firstCmd + it->cmdCount; i++) {
+	out += " - '";
+	out += this->_cmds[i];
+	out += "'";
+	if (i + 1 != it->firstCmd + it->cmdCount)
 	  out += "\n";
       }
     }
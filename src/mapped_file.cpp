@@ -0,0 +1,74 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mapped_file.hpp"
+
+MappedFile::MappedFile() : _data(nullptr), _size(0)
+{}
+
+MappedFile::MappedFile(const std::string &path) : _data(nullptr), _size(0)
+{
+  struct stat st;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    throw MakefileException("Failed to open " + path);
+  }
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    throw MakefileException("Failed to open " + path);
+  }
+  this->_size = st.st_size;
+  if (this->_size > 0) {
+    void *addr = mmap(nullptr, this->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw MakefileException("Failed to map " + path);
+    }
+    madvise(addr, this->_size, MADV_SEQUENTIAL);
+    this->_data = static_cast<const char *>(addr);
+  }
+  close(fd);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : _data(other._data), _size(other._size)
+{
+  other._data = nullptr;
+  other._size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+  if (this->_data != nullptr)
+    munmap(const_cast<char *>(this->_data), this->_size);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+  if (this != &other) {
+    if (this->_data != nullptr)
+      munmap(const_cast<char *>(this->_data), this->_size);
+    this->_data = other._data;
+    this->_size = other._size;
+    other._data = nullptr;
+    other._size = 0;
+  }
+  return *this;
+}
+
+std::string_view MappedFile::view() const
+{
+  return std::string_view(this->_data, this->_size);
+}
+
+const char *MappedFile::data() const
+{
+  return this->_data;
+}
+
+size_t MappedFile::size() const
+{
+  return this->_size;
+}
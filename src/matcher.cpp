@@ -0,0 +1,216 @@
+#include <cstring>
+#include "exception.hpp"
+#include "hash.hpp"
+#include "matcher.hpp"
+
+template <typename T>
+static void appendSection(std::string &out, const T *data, size_t count)
+{
+  uint64_t header = count;
+
+  out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.append(reinterpret_cast<const char *>(data), count * sizeof(T));
+  out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+template <typename T>
+static Span<T> loadSection(const char *data, size_t size, size_t &pos)
+{
+  uint64_t count;
+  const T *items;
+
+  if (size - pos < sizeof(count))
+    throw MakefileException("truncated rules cache");
+  std::memcpy(&count, data + pos, sizeof(count));
+  pos += sizeof(count);
+  if (count > (size - pos) / sizeof(T))
+    throw MakefileException("truncated rules cache");
+  items = reinterpret_cast<const T *>(data + pos);
+  pos += count * sizeof(T);
+  pos += (8 - pos % 8) % 8;
+  if (pos > size)
+    throw MakefileException("truncated rules cache");
+  return Span<T>(items, count);
+}
+
+void Matcher::add(std::string_view pattern)
+{
+  this->_patterns.push_back({static_cast<uint32_t>(this->_strings.size()), static_cast<uint32_t>(pattern.size())});
+  this->_strings.append(pattern);
+}
+
+void Matcher::compile()
+{
+  size_t capacity = 1;
+
+  this->_exact.clear();
+  this->_prefix.clear();
+  this->_suffix.clear();
+  this->_globs.clear();
+  while (capacity < this->_patterns.size() * 2)
+    capacity <<= 1;
+  this->_exact.assign(capacity, {0, none});
+  this->_bind();
+  for (uint32_t i = 0; i < this->_patterns.size(); i++) {
+    std::string_view pattern = this->pattern(i);
+    size_t star = pattern.find('*');
+
+    if (!Matcher::isGlob(pattern)) {
+      uint32_t hash = static_cast<uint32_t>(hash64(pattern));
+      size_t slot = hash & (capacity - 1);
+
+      if (this->_exactFind(pattern) != none)
+        continue;
+      while (this->_exact[slot].pattern != none)
+        slot = (slot + 1) & (capacity - 1);
+      this->_exact[slot] = {hash, i};
+    }
+    else if (star == pattern.size() - 1 && !Matcher::isGlob(pattern.substr(0, star)))
+      this->_insert(this->_prefix, pattern.substr(0, star), false, i);
+    else if (star == 0 && !Matcher::isGlob(pattern.substr(1)))
+      this->_insert(this->_suffix, pattern.substr(1), true, i);
+    else
+      this->_globs.push_back(i);
+  }
+  this->_bind();
+}
+
+void Matcher::serialize(std::string &out) const
+{
+  appendSection(out, this->_stringsView.begin(), this->_stringsView.size());
+  appendSection(out, this->_patternsView.begin(), this->_patternsView.size());
+  appendSection(out, this->_exactView.begin(), this->_exactView.size());
+  appendSection(out, this->_prefixView.begin(), this->_prefixView.size());
+  appendSection(out, this->_suffixView.begin(), this->_suffixView.size());
+  appendSection(out, this->_globsView.begin(), this->_globsView.size());
+}
+
+size_t Matcher::load(const char *data, size_t size)
+{
+  size_t pos = 0;
+
+  this->_stringsView = loadSection<char>(data, size, pos);
+  this->_patternsView = loadSection<Pattern>(data, size, pos);
+  this->_exactView = loadSection<Slot>(data, size, pos);
+  this->_prefixView = loadSection<Node>(data, size, pos);
+  this->_suffixView = loadSection<Node>(data, size, pos);
+  this->_globsView = loadSection<uint32_t>(data, size, pos);
+  if ((this->_exactView.size() & (this->_exactView.size() - 1)) != 0)
+    throw MakefileException("corrupted rules cache");
+  for (const Pattern &pattern: this->_patternsView) {
+    if (pattern.offset > this->_stringsView.size() || pattern.size > this->_stringsView.size() - pattern.offset)
+      throw MakefileException("corrupted rules cache");
+  }
+  return pos;
+}
+
+size_t Matcher::size() const
+{
+  return this->_patternsView.size();
+}
+
+std::string_view Matcher::pattern(uint32_t index) const
+{
+  return std::string_view(this->_stringsView.begin() + this->_patternsView[index].offset, this->_patternsView[index].size);
+}
+
+int Matcher::find(std::string_view name) const
+{
+  int found = -1;
+
+  this->forEachMatch(name, [&found](uint32_t pattern) {
+    if (found < 0 || static_cast<int>(pattern) < found)
+      found = pattern;
+  });
+  return found;
+}
+
+bool Matcher::isGlob(std::string_view pattern)
+{
+  return pattern.find_first_of("*?") != std::string_view::npos;
+}
+
+bool Matcher::glob(std::string_view pattern, std::string_view name)
+{
+  size_t p = 0;
+  size_t n = 0;
+  size_t star = std::string_view::npos;
+  size_t backtrack = 0;
+
+  while (n < name.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+      p++;
+      n++;
+    }
+    else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      backtrack = n;
+    }
+    else if (star != std::string_view::npos) {
+      p = star + 1;
+      n = ++backtrack;
+    }
+    else
+      return false;
+  }
+  while (p < pattern.size() && pattern[p] == '*')
+    p++;
+  return p == pattern.size();
+}
+
+uint32_t Matcher::_exactFind(std::string_view name) const
+{
+  uint32_t hash;
+  size_t slot;
+
+  if (this->_exactView.empty())
+    return none;
+  hash = static_cast<uint32_t>(hash64(name));
+  slot = hash & (this->_exactView.size() - 1);
+  for (size_t probe = 0; probe < this->_exactView.size() && this->_exactView[slot].pattern != none; probe++) {
+    if (this->_exactView[slot].hash == hash && this->pattern(this->_exactView[slot].pattern) == name)
+      return this->_exactView[slot].pattern;
+    slot = (slot + 1) & (this->_exactView.size() - 1);
+  }
+  return none;
+}
+
+uint32_t Matcher::_child(Span<Node> trie, uint32_t node, char c) const
+{
+  for (uint32_t child = trie[node].child; child != none; child = trie[child].sibling) {
+    if (trie[child].c == static_cast<unsigned char>(c))
+      return child;
+  }
+  return none;
+}
+
+void Matcher::_insert(std::vector<Node> &trie, std::string_view key, bool reversed, uint32_t pattern)
+{
+  uint32_t node = 0;
+
+  if (trie.empty())
+    trie.push_back({none, none, none, '\0'});
+  for (size_t i = 0; i < key.size(); i++) {
+    char c = (reversed ? key[key.size() - 1 - i] : key[i]);
+    uint32_t child = this->_child(Span<Node>(trie.data(), trie.size()), node, c);
+
+    if (child == none) {
+      child = trie.size();
+      trie.push_back({none, trie[node].child, none, static_cast<unsigned char>(c)});
+      trie[node].child = child;
+    }
+    node = child;
+  }
+  if (trie[node].pattern == none)
+    trie[node].pattern = pattern;
+}
+
+void Matcher::_bind()
+{
+  this->_stringsView = Span<char>(this->_strings.data(), this->_strings.size());
+  this->_patternsView = Span<Pattern>(this->_patterns.data(), this->_patterns.size());
+  this->_exactView = Span<Slot>(this->_exact.data(), this->_exact.size());
+  this->_prefixView = Span<Node>(this->_prefix.data(), this->_prefix.size());
+  this->_suffixView = Span<Node>(this->_suffix.data(), this->_suffix.size());
+  this->_globsView = Span<uint32_t>(this->_globs.data(), this->_globs.size());
+}
@@ -0,0 +1,79 @@
+#include <unistd.h>
+#include <cerrno>
+#include "ordered_output.hpp"
+#include "stats.hpp"
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+OrderedOutput::OrderedOutput(size_t count, std::string_view separator) : _slots(count), _next(0), _held(0), _separator(separator), _written(false)
+{
+  this->_out.reserve(flushThreshold);
+}
+
+OrderedOutput::~OrderedOutput()
+{
+  this->flush();
+}
+
+void OrderedOutput::wait(size_t index)
+{
+  std::unique_lock<std::mutex> lock(this->_mutex);
+
+  this->_merged.wait(lock, [this, index]() { return index <= this->_next || this->_held < heldLimit; });
+}
+
+void OrderedOutput::complete(size_t index, std::string &&out, std::string &&err)
+{
+  Stats::Timer timer(Stats::Output);
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  size_t next = this->_next;
+
+  this->_held += out.size() + err.size();
+  this->_slots[index] = {std::move(out), std::move(err), true};
+  for (; this->_next < this->_slots.size() && this->_slots[this->_next].done; this->_next++) {
+    Slot &slot = this->_slots[this->_next];
+
+    this->_held -= slot.out.size() + slot.err.size();
+    if (!slot.out.empty()) {
+      if (this->_written)
+        this->_out += this->_separator;
+      this->_out += slot.out;
+      this->_written = true;
+    }
+    this->_err += slot.err;
+    std::string().swap(slot.out);
+    std::string().swap(slot.err);
+    if (this->_out.size() >= flushThreshold || this->_err.size() >= flushThreshold)
+      this->_flush();
+  }
+  if (this->_next != next)
+    this->_merged.notify_all();
+}
+
+void OrderedOutput::flush()
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+
+  this->_flush();
+}
+
+void OrderedOutput::_flush()
+{
+  writeAll(STDOUT_FILENO, this->_out.data(), this->_out.size());
+  writeAll(STDERR_FILENO, this->_err.data(), this->_err.size());
+  this->_out.clear();
+  this->_err.clear();
+}
@@ -0,0 +1,118 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "expander.hpp"
+#include "overlay.hpp"
+#include "patterns.hpp"
+
+Overlay::Overlay(const Makefile &makefile, std::string_view target) : _makefile(makefile)
+{
+  std::unique_ptr<Expander> expander;
+  std::vector<const Makefile *> sources = {&makefile};
+  std::vector<const Makefile::Scope *> patterns;
+  std::vector<const Makefile::Scope *> targets;
+
+  this->_target = this->_arena.store(target);
+  for (const std::shared_ptr<const Makefile> &fragment: makefile.included())
+    sources.push_back(fragment.get());
+  for (const Makefile *source: sources) {
+    for (const Makefile::Scope &scope: source->scopes()) {
+      std::string_view names = scope.target;
+      std::string expanded;
+
+      if (names.find('$') != std::string_view::npos) {
+        if (expander == nullptr)
+          expander = std::make_unique<Expander>(makefile);
+        expanded = expander->expand(names);
+        names = expanded;
+      }
+      for (std::string_view name: Words(names)) {
+        std::string_view stem;
+
+        if (name == target) {
+          targets.push_back(&scope);
+          break;
+        }
+        if (name.find('%') != std::string_view::npos && Patterns::match(name, target, stem)) {
+          patterns.push_back(&scope);
+          break;
+        }
+      }
+    }
+  }
+  for (const Makefile::Scope *scope: patterns)
+    this->_apply(*scope);
+  for (const Makefile::Scope *scope: targets)
+    this->_apply(*scope);
+}
+
+size_t Overlay::size() const
+{
+  return this->_layer.size();
+}
+
+std::string_view Overlay::target() const
+{
+  return this->_target;
+}
+
+const std::map<std::string_view, Makefile::Variable> &Overlay::variables() const
+{
+  return this->_layer;
+}
+
+const Makefile::Variable *Overlay::find(std::string_view name) const
+{
+  auto found = this->_layer.find(name);
+
+  return (found == this->_layer.end() ? nullptr : &found->second);
+}
+
+const Makefile::Variable *Overlay::lookup(std::string_view name) const
+{
+  const Makefile::Variable *variable = this->find(name);
+
+  if (variable != nullptr)
+    return variable;
+  auto found = this->_makefile.variables().find(name);
+
+  if (found != this->_makefile.variables().end())
+    return &found->second;
+  for (auto fragment = this->_makefile.included().rbegin(); fragment != this->_makefile.included().rend(); fragment++) {
+    found = (*fragment)->variables().find(name);
+    if (found != (*fragment)->variables().end())
+      return &found->second;
+  }
+  return nullptr;
+}
+
+void Overlay::_apply(const Makefile::Scope &scope)
+{
+  const Makefile::Variable *current = this->lookup(scope.name);
+  Makefile::Variable variable = {scope.value, scope.line, Makefile::Variable::Recursive, this->_makefile.generation()};
+
+  if (scope.op == '?' && current != nullptr)
+    return;
+  if (scope.op == '+' && current != nullptr) {
+    std::string value(current->value);
+
+    if (!value.empty() && !scope.value.empty())
+      value += " ";
+    value += scope.value;
+    variable.value = this->_arena.store(value);
+    variable.flavor = current->flavor;
+  }
+  else if (scope.op == ':')
+    variable.flavor = Makefile::Variable::Simple;
+  if (variable.flavor == Makefile::Variable::Simple && scope.value.find('$') != std::string_view::npos) {
+    Expander expander(this->_makefile, this);
+    std::string value = expander.expand(scope.value);
+
+    if (scope.op == '+' && current != nullptr)
+      value = (current->value.empty() || value.empty() ? std::string(current->value) + value : std::string(current->value) + " " + value);
+    variable.value = this->_arena.store(value);
+  }
+  else if (scope.op == '!')
+    variable.flavor = Makefile::Variable::Shell;
+  this->_layer[scope.name] = variable;
+}
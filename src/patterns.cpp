@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include "expander.hpp"
+#include "hash.hpp"
+#include "patterns.hpp"
+
+Patterns::Patterns(const Makefile &makefile)
+{
+  std::unique_ptr<Expander> expander;
+  std::vector<const Makefile *> sources = {&makefile};
+  uint32_t order = 0;
+
+  for (const std::shared_ptr<const Makefile> &fragment: makefile.included())
+    sources.push_back(fragment.get());
+  for (const Makefile *source: sources) {
+    for (const Makefile::Receipe &receipe: source->receipes()) {
+      std::string_view names = receipe.target;
+
+      if (receipe.cmdCount == 0 || !receipe.pattern.empty())
+        continue;
+      if (names.find('$') != std::string_view::npos) {
+        if (expander == nullptr)
+          expander = std::make_unique<Expander>(makefile);
+        names = this->_arena.store(expander->expand(names));
+      }
+      if (names.find('%') == std::string_view::npos)
+        continue;
+      for (std::string_view name: Words(names)) {
+        size_t percent = name.find('%');
+
+        if (percent != std::string_view::npos)
+          this->_rules.push_back({name, name.substr(0, percent), name.substr(percent + 1), &receipe, order++, name.find('/') == std::string_view::npos});
+      }
+    }
+  }
+  size_t capacity = 1;
+
+  while (capacity < this->_rules.size() * 2)
+    capacity <<= 1;
+  this->_index.assign(capacity, {0, none});
+  for (uint32_t i = 0; i < this->_rules.size(); i++) {
+    const Rule &rule = this->_rules[i];
+    uint32_t hash = _hash(rule.prefix, rule.suffix, rule.local);
+    size_t slot = hash & (capacity - 1);
+
+    if (this->_find(rule.prefix, rule.suffix, rule.local) != none)
+      continue;
+    while (this->_index[slot].rule != none)
+      slot = (slot + 1) & (capacity - 1);
+    this->_index[slot] = {hash, i};
+    this->_shapes.push_back({static_cast<uint32_t>(rule.prefix.size()), static_cast<uint32_t>(rule.suffix.size()), rule.local});
+  }
+  std::sort(this->_shapes.begin(), this->_shapes.end(), _before);
+  this->_shapes.erase(std::unique(this->_shapes.begin(), this->_shapes.end(), [](const Shape &a, const Shape &b) {
+    return !_before(a, b) && !_before(b, a);
+  }), this->_shapes.end());
+}
+
+size_t Patterns::size() const
+{
+  return this->_rules.size();
+}
+
+const Patterns::Rule *Patterns::find(std::string_view name, std::string &stem) const
+{
+  size_t slash = name.rfind('/');
+  std::string_view directory = (slash == std::string_view::npos ? std::string_view() : name.substr(0, slash + 1));
+  const Rule *best = nullptr;
+  size_t shortest = SIZE_MAX;
+
+  for (const Shape &shape: this->_shapes) {
+    std::string_view subject = (shape.local ? name.substr(directory.size()) : name);
+
+    if (subject.size() <= shape.prefix + shape.suffix || subject.size() - shape.prefix - shape.suffix > shortest)
+      continue;
+    size_t size = subject.size() - shape.prefix - shape.suffix;
+    uint32_t found = this->_find(subject.substr(0, shape.prefix), name.substr(name.size() - shape.suffix), shape.local);
+
+    if (found == none)
+      continue;
+    if (size < shortest || this->_rules[found].order < best->order) {
+      best = &this->_rules[found];
+      shortest = size;
+    }
+  }
+  if (best == nullptr)
+    return nullptr;
+  if (best->local) {
+    stem = directory;
+    stem += name.substr(directory.size() + best->prefix.size(), shortest);
+  }
+  else
+    stem = name.substr(best->prefix.size(), shortest);
+  return best;
+}
+
+bool Patterns::match(std::string_view pattern, std::string_view name, std::string_view &stem)
+{
+  size_t percent = pattern.find('%');
+
+  if (percent == std::string_view::npos) {
+    stem = std::string_view();
+    return pattern == name;
+  }
+  std::string_view prefix = pattern.substr(0, percent);
+  std::string_view suffix = pattern.substr(percent + 1);
+
+  if (name.size() <= prefix.size() + suffix.size() || !starts_with(name, prefix) || !ends_with(name, suffix))
+    return false;
+  stem = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+  return true;
+}
+
+std::string Patterns::substitute(std::string_view pattern, std::string_view stem)
+{
+  size_t percent = pattern.find('%');
+  std::string result(pattern);
+
+  if (percent != std::string_view::npos)
+    result.replace(percent, 1, stem);
+  return result;
+}
+
+bool Patterns::_before(const Shape &a, const Shape &b)
+{
+  if (a.prefix + a.suffix != b.prefix + b.suffix)
+    return a.prefix + a.suffix > b.prefix + b.suffix;
+  if (a.prefix != b.prefix)
+    return a.prefix < b.prefix;
+  return a.local && !b.local;
+}
+
+uint32_t Patterns::_hash(std::string_view prefix, std::string_view suffix, bool local)
+{
+  return static_cast<uint32_t>(hash64(suffix, hash64(prefix, local)));
+}
+
+uint32_t Patterns::_find(std::string_view prefix, std::string_view suffix, bool local) const
+{
+  uint32_t hash = _hash(prefix, suffix, local);
+  size_t slot = hash & (this->_index.size() - 1);
+
+  for (size_t probe = 0; probe < this->_index.size() && this->_index[slot].rule != none; probe++) {
+    const Rule &rule = this->_rules[this->_index[slot].rule];
+
+    if (this->_index[slot].hash == hash && rule.local == local && rule.prefix == prefix && rule.suffix == suffix)
+      return this->_index[slot].rule;
+    slot = (slot + 1) & (this->_index.size() - 1);
+  }
+  return none;
+}
@@ -0,0 +1,292 @@
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "hash.hpp"
+#include "result_cache.hpp"
+
+static const char indexMagic[8] = {'C', 'M', 'K', 'I', 'N', 'D', 'E', 'X'};
+static const uint32_t indexVersion = 3;
+static const uint64_t maxAge = 16;
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+class FileLock {
+public:
+  FileLock(const std::string &path, int operation) : _fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+    if (this->_fd >= 0 && flock(this->_fd, operation) != 0) {
+      close(this->_fd);
+      this->_fd = -1;
+    }
+  }
+  ~FileLock() {
+    if (this->_fd >= 0)
+      close(this->_fd);
+  }
+  bool isLocked() const { return this->_fd >= 0; }
+private:
+  int _fd;
+};
+
+ResultCache::ResultCache(const std::string &directory, uint64_t fingerprint) : _directory(directory), _indexPath(directory + "/index"), _dataPath(directory + "/data"), _lockPath(directory + "/lock"), _fingerprint(fingerprint), _generation(0)
+{
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw MakefileException("Failed to create cache directory " + directory);
+  }
+  FileLock lock(this->_lockPath, LOCK_SH);
+
+  if (lock.isLocked())
+    this->_map();
+}
+
+uint64_t ResultCache::key(std::string_view content) const
+{
+  uint64_t key = hash64(content, this->_fingerprint ^ indexVersion);
+
+  return (key == 0 ? 1 : key);
+}
+
+uint64_t ResultCache::key(uint64_t key, uint64_t dependencies) const
+{
+  key = hash64(&dependencies, sizeof(dependencies), key);
+  return (key == 0 ? 1 : key);
+}
+
+bool ResultCache::lookup(uint64_t key, DiagnosticBuffer &diagnostics) const
+{
+  std::string_view record;
+
+  return this->_find(key, record) && diagnostics.load(record.data(), record.size());
+}
+
+bool ResultCache::lookup(uint64_t key, std::vector<std::string> &dependencies) const
+{
+  std::string_view record;
+  uint32_t count;
+
+  dependencies.clear();
+  if (!this->_find(key, record) || record.size() < sizeof(count))
+    return false;
+  std::memcpy(&count, record.data(), sizeof(count));
+  record.remove_prefix(sizeof(count));
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t size;
+
+    if (record.size() < sizeof(size))
+      return false;
+    std::memcpy(&size, record.data(), sizeof(size));
+    record.remove_prefix(sizeof(size));
+    if (record.size() < size)
+      return false;
+    dependencies.emplace_back(record.substr(0, size));
+    record.remove_prefix(size);
+  }
+  return record.empty();
+}
+
+void ResultCache::store(uint64_t key, const DiagnosticBuffer &diagnostics)
+{
+  std::string record;
+
+  diagnostics.serialize(record);
+  this->_store(key, std::move(record));
+}
+
+void ResultCache::store(uint64_t key, const std::vector<std::string> &dependencies)
+{
+  uint32_t count = dependencies.size();
+  std::string record(reinterpret_cast<const char *>(&count), sizeof(count));
+
+  for (const std::string &path: dependencies) {
+    uint32_t size = path.size();
+
+    record.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    record += path;
+  }
+  this->_store(key, std::move(record));
+}
+
+uint64_t ResultCache::signature(const std::vector<std::string> &paths)
+{
+  uint64_t hash = paths.size();
+
+  for (const std::string &path: paths) {
+    struct stat info;
+    uint64_t fields[6] = {0, 0, 0, 0, 0, 0};
+
+    if (stat(path.c_str(), &info) == 0) {
+      fields[0] = info.st_dev;
+      fields[1] = info.st_ino;
+      fields[2] = info.st_size;
+      fields[3] = info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+      fields[4] = info.st_ctim.tv_sec * 1000000000ull + info.st_ctim.tv_nsec;
+      fields[5] = 1;
+    }
+    hash = hash64(path, hash);
+    hash = hash64(fields, sizeof(fields), hash);
+  }
+  return hash;
+}
+
+void ResultCache::flush()
+{
+  std::lock_guard<std::mutex> guard(this->_mutex);
+  std::vector<Slot> entries;
+  std::vector<Slot> slots;
+  Header header;
+  size_t capacity = 16;
+  uint64_t generation;
+  uint64_t live = 0;
+  uint64_t offset = 0;
+  std::string dataPath;
+  std::string tmp = "." + std::to_string(getpid()) + ".tmp";
+  bool compact;
+  int fd;
+  bool written;
+
+  if (this->_pending.empty() && this->_touched.empty())
+    return;
+  FileLock lock(this->_lockPath, LOCK_EX);
+
+  if (!lock.isLocked())
+    return;
+  this->_map();
+  generation = this->_generation + 1;
+  for (Slot slot: this->_slots) {
+    if (slot.key == 0 || this->_pendingKeys.count(slot.key) > 0)
+      continue;
+    if (this->_touched.count(slot.key) > 0)
+      slot.generation = generation;
+    if (slot.generation + maxAge < generation)
+      continue;
+    entries.push_back(slot);
+    live += slot.size;
+  }
+  compact = this->_data.size() > 2 * live + (1 << 20) || (this->_slots.empty() && this->_data.size() > 0);
+  dataPath = (compact ? this->_dataPath + tmp : this->_dataPath);
+  fd = open(dataPath.c_str(), O_WRONLY | O_CREAT | (compact ? O_TRUNC : O_APPEND) | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return;
+  offset = (compact ? 0 : this->_data.size());
+  written = true;
+  if (compact) {
+    for (Slot &entry: entries) {
+      written = written && writeAll(fd, this->_data.data() + entry.offset, entry.size);
+      entry.offset = offset;
+      offset += entry.size;
+    }
+  }
+  for (const auto &[key, record]: this->_pending) {
+    written = written && writeAll(fd, record.data(), record.size());
+    entries.push_back({key, offset, record.size(), generation});
+    offset += record.size();
+  }
+  close(fd);
+  this->_pending.clear();
+  this->_pendingKeys.clear();
+  this->_touched.clear();
+  if (!written || (compact && rename(dataPath.c_str(), this->_dataPath.c_str()) != 0)) {
+    if (compact)
+      unlink(dataPath.c_str());
+    return;
+  }
+  while (capacity < entries.size() * 2)
+    capacity <<= 1;
+  slots.assign(capacity, {0, 0, 0, 0});
+  for (const Slot &entry: entries) {
+    size_t slot = entry.key & (capacity - 1);
+
+    while (slots[slot].key != 0 && slots[slot].key != entry.key)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = entry;
+  }
+  std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+  header.version = indexVersion;
+  header.headerSize = sizeof(header);
+  header.fingerprint = this->_fingerprint;
+  header.capacity = capacity;
+  header.count = entries.size();
+  header.dataSize = offset;
+  header.generation = generation;
+  fd = open((this->_indexPath + tmp).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return;
+  written = writeAll(fd, reinterpret_cast<const char *>(&header), sizeof(header)) &&
+    writeAll(fd, reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(Slot));
+  close(fd);
+  if (!written || rename((this->_indexPath + tmp).c_str(), this->_indexPath.c_str()) != 0)
+    unlink((this->_indexPath + tmp).c_str());
+}
+
+bool ResultCache::_find(uint64_t key, std::string_view &record) const
+{
+  size_t mask = this->_slots.size() - 1;
+
+  if (this->_slots.empty())
+    return false;
+  for (size_t slot = key & mask, probe = 0; probe < this->_slots.size() && this->_slots[slot].key != 0; slot = (slot + 1) & mask, probe++) {
+    const Slot &entry = this->_slots[slot];
+
+    if (entry.key != key)
+      continue;
+    if (entry.offset > this->_data.size() || entry.size > this->_data.size() - entry.offset)
+      return false;
+    record = std::string_view(this->_data.data() + entry.offset, entry.size);
+    if (entry.generation != this->_generation) {
+      std::lock_guard<std::mutex> guard(this->_mutex);
+
+      this->_touched.insert(key);
+    }
+    return true;
+  }
+  return false;
+}
+
+void ResultCache::_store(uint64_t key, std::string &&record)
+{
+  std::lock_guard<std::mutex> guard(this->_mutex);
+
+  if (this->_pendingKeys.insert(key).second)
+    this->_pending.emplace_back(key, std::move(record));
+}
+
+bool ResultCache::_map()
+{
+  Header header;
+
+  this->_slots = Span<Slot>();
+  this->_generation = 0;
+  try {
+    this->_index = MappedFile(this->_indexPath);
+    this->_data = MappedFile(this->_dataPath);
+  }
+  catch (const MakefileException &e) {
+    return false;
+  }
+  if (this->_index.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, this->_index.data(), sizeof(header));
+  if (std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != indexVersion ||
+      header.headerSize != sizeof(header) || header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+      header.capacity != (this->_index.size() - sizeof(header)) / sizeof(Slot) || header.dataSize > this->_data.size() ||
+      header.fingerprint != this->_fingerprint)
+    return false;
+  this->_slots = Span<Slot>(reinterpret_cast<const Slot *>(this->_index.data() + sizeof(header)), header.capacity);
+  this->_generation = header.generation;
+  return true;
+}
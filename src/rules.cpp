@@ -1,28 +1,410 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include "hash.hpp"
 #include "rules.hpp"
+#include "stats.hpp"
 
-Rules::Rules(const std::string &path, bool verbose) : _path(path), _verbose(verbose)
+static const char cacheMagic[8] = {'C', 'M', 'K', 'R', 'U', 'L', 'E', 'S'};
+static const uint32_t cacheVersion = 2;
+static const size_t maxCycleNames = 16;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+  uint64_t payloadSize;
+  uint64_t payloadHash;
+};
+
+static int64_t mtime(const struct stat &st)
+{
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static bool writeAll(int fd, const char *data, size_t size)
 {
-  std::ifstream file(path);
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
 
-  if (!file.is_open()) {
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool makeDirectories(const std::string &path)
+{
+  for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+    if (mkdir(path.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (slash == std::string::npos)
+      return true;
+  }
+}
+
+static std::string cachePath(const std::string &path, const std::string &directory)
+{
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  const char *home = std::getenv("HOME");
+  char *canonical = realpath(path.c_str(), nullptr);
+  std::string base = directory;
+  char name[32];
+
+  if (base.empty() && xdg != nullptr && xdg[0] == '/')
+    base = std::string(xdg) + "/checkmake";
+  else if (base.empty() && home != nullptr && home[0] == '/')
+    base = std::string(home) + "/.cache/checkmake";
+  if (canonical == nullptr || base.empty() || !makeDirectories(base)) {
+    std::free(canonical);
+    return "";
+  }
+  std::snprintf(name, sizeof(name), "/rules-%016llx.cache", static_cast<unsigned long long>(hash64(canonical, std::strlen(canonical))));
+  std::free(canonical);
+  return base + name;
+}
+
+Rules::Rules(const std::string &path, bool verbose, const std::string &cacheDirectory) : _path(path), _cachePath(cachePath(path, cacheDirectory)), _verbose(verbose), _hash(0), _graphChecks(0), _root("all")
+{
+  Stats::Timer timer(Stats::Rules);
+  struct stat st;
+  uint64_t sourceHash;
+  json rules;
+
+  if (!this->_verbose && stat(path.c_str(), &st) == 0 && this->_loadCache(st, nullptr))
+    return;
+  MappedFile file(path);
+
+  if (stat(path.c_str(), &st) != 0) {
     throw MakefileException("Failed to open " + path);
   }
+  sourceHash = hash64(file.view());
+  if (!this->_verbose && this->_loadCache(st, &sourceHash))
+    return;
   try {
-    file >> this->_rules;
+    rules = json::parse(file.view().begin(), file.view().end());
   }
-  catch (nlohmann::detail::parse_error e) {
+  catch (const nlohmann::detail::parse_error &e) {
     throw MakefileException(path + " is not a valid JSON file");
   }
   if (this->_verbose) {
-    std::cout << std::setw(4) << this->_rules << std::endl;
+    std::cout << std::setw(4) << rules << std::endl;
+  }
+  if (!rules.is_object()) {
+    throw MakefileException(path + " must contain a JSON object");
   }
+  this->_compile(rules, "include", "rules", this->_include.rules);
+  this->_compile(rules, "include", "variables", this->_include.variables);
+  this->_compile(rules, "exclude", "rules", this->_exclude.rules);
+  this->_compile(rules, "exclude", "variables", this->_exclude.variables);
+  this->_compileGraph(rules);
+  this->_saveCache(st, sourceHash);
 }
 
 Rules::~Rules()
 {}
 
-int Rules::check(const Makefile &makefile)
+int Rules::check(const Makefile &makefile, DiagnosticSink &sink) const
+{
+  return this->checkRules(makefile, sink) + this->checkVariables(makefile, sink) + this->checkGraph(makefile, sink);
+}
+
+uint64_t Rules::fingerprint() const
+{
+  return this->_hash;
+}
+
+int Rules::checkRules(const Makefile &makefile, DiagnosticSink &sink) const
+{
+  std::vector<bool> required(this->_include.rules.size(), false);
+  std::unique_ptr<Expander> expander;
+  int found = 0;
+  auto expand = [&makefile, &expander](std::string_view targets, std::string &expanded) -> std::string_view {
+    if (targets.find('$') == std::string_view::npos)
+      return targets;
+    if (expander == nullptr)
+      expander = std::make_unique<Expander>(makefile);
+    expanded = expander->expand(targets);
+    return expanded;
+  };
+
+  for (const Makefile::Receipe &receipe: makefile.receipes()) {
+    std::string expanded;
+
+    for (std::string_view target: Words(expand(receipe.target, expanded))) {
+      int pattern = this->_exclude.rules.find(target);
+
+      this->_include.rules.forEachMatch(target, [&required](uint32_t index) { required[index] = true; });
+      if (pattern >= 0) {
+        sink.report({Diagnostic::ForbiddenRule, makefile.getPath(), receipe.line, target, this->_exclude.rules.pattern(pattern)});
+        found++;
+      }
+    }
+  }
+  for (size_t i = 0; i < makefile.included().size() && !required.empty(); i++) {
+    for (const Makefile::Receipe &receipe: makefile.included()[i]->receipes()) {
+      std::string expanded;
+
+      for (std::string_view target: Words(expand(receipe.target, expanded)))
+        this->_include.rules.forEachMatch(target, [&required](uint32_t index) { required[index] = true; });
+    }
+  }
+  for (size_t i = 0; i < required.size(); i++) {
+    if (!required[i]) {
+      sink.report({Diagnostic::MissingRule, makefile.getPath(), 0, std::string_view(), this->_include.rules.pattern(i)});
+      found++;
+    }
+  }
+  return found;
+}
+
+int Rules::checkVariables(const Makefile &makefile, DiagnosticSink &sink) const
+{
+  std::vector<bool> required(this->_include.variables.size(), false);
+  int found = 0;
+
+  for (const auto &[name, variable]: makefile.variables()) {
+    int pattern = this->_exclude.variables.find(name);
+
+    this->_include.variables.forEachMatch(name, [&required](uint32_t index) { required[index] = true; });
+    if (pattern >= 0) {
+      sink.report({Diagnostic::ForbiddenVariable, makefile.getPath(), variable.line, name, this->_exclude.variables.pattern(pattern)});
+      found++;
+    }
+  }
+  for (const Makefile::Scope &scope: makefile.scopes()) {
+    int pattern = this->_exclude.variables.find(scope.name);
+
+    this->_include.variables.forEachMatch(scope.name, [&required](uint32_t index) { required[index] = true; });
+    if (pattern >= 0) {
+      sink.report({Diagnostic::ForbiddenVariable, makefile.getPath(), scope.line, scope.name, this->_exclude.variables.pattern(pattern)});
+      found++;
+    }
+  }
+  for (size_t i = 0; i < makefile.included().size() && !required.empty(); i++) {
+    for (const auto &[name, variable]: makefile.included()[i]->variables())
+      this->_include.variables.forEachMatch(name, [&required](uint32_t index) { required[index] = true; });
+    for (const Makefile::Scope &scope: makefile.included()[i]->scopes())
+      this->_include.variables.forEachMatch(scope.name, [&required](uint32_t index) { required[index] = true; });
+  }
+  for (size_t i = 0; i < required.size(); i++) {
+    if (!required[i]) {
+      sink.report({Diagnostic::MissingVariable, makefile.getPath(), 0, std::string_view(), this->_include.variables.pattern(i)});
+      found++;
+    }
+  }
+  return found;
+}
+
+int Rules::checkGraph(const Makefile &makefile, DiagnosticSink &sink) const
+{
+  int found = 0;
+
+  if (this->_graphChecks == 0)
+    return 0;
+  Graph graph(makefile);
+
+  if (this->_graphChecks & CycleCheck) {
+    for (const std::vector<uint32_t> &cycle: graph.cycles()) {
+      std::string members;
+
+      for (size_t i = 0; i < cycle.size() && i < maxCycleNames; i++) {
+        if (!members.empty())
+          members += ' ';
+        members += graph.name(cycle[i]);
+      }
+      if (cycle.size() > maxCycleNames)
+        members += " ... (" + std::to_string(cycle.size()) + " targets)";
+      sink.report({Diagnostic::DependencyCycle, makefile.getPath(), graph.line(cycle[0]), graph.name(cycle[0]), members});
+      found++;
+    }
+  }
+  if (this->_graphChecks & UnreachableCheck) {
+    int root = graph.find(this->_root);
+
+    if (root < 0 || !(graph.flags(root) & Graph::Rule))
+      root = graph.defaultGoal();
+    if (root >= 0) {
+      for (uint32_t node: graph.unreachable(root)) {
+        if (!(graph.flags(node) & Graph::Local))
+          continue;
+        sink.report({Diagnostic::UnreachableTarget, makefile.getPath(), graph.line(node), graph.name(node), graph.name(root)});
+        found++;
+      }
+    }
+  }
+  if (this->_graphChecks & PhonyCheck) {
+    for (uint32_t node: graph.missingPhony()) {
+      if (!(graph.flags(node) & Graph::Local))
+        continue;
+      sink.report({Diagnostic::MissingPhony, makefile.getPath(), graph.line(node), graph.name(node), std::string_view()});
+      found++;
+    }
+  }
+  return found;
+}
+
+void Rules::_compile(const json &rules, const std::string &section, const std::string &key, Matcher &matcher) const
+{
+  std::unordered_set<std::string> seen;
+  auto found = rules.find(section);
+
+  if (found != rules.end() && found->is_object() && found->contains(key)) {
+    const json &patterns = found->at(key);
+
+    if (!patterns.is_array()) {
+      throw MakefileException(this->_path + ": " + section + "." + key + " must be an array of strings");
+    }
+    for (const json &pattern: patterns) {
+      if (!pattern.is_string()) {
+        throw MakefileException(this->_path + ": " + section + "." + key + " must be an array of strings");
+      }
+      if (seen.insert(pattern.get<std::string>()).second)
+        matcher.add(pattern.get<std::string>());
+    }
+  }
+  else if (found != rules.end() && !found->is_object()) {
+    throw MakefileException(this->_path + ": " + section + " must be an object");
+  }
+  matcher.compile();
+}
+
+void Rules::_compileGraph(const json &rules)
 {
-  (void)makefile;
-  return 0;
+  auto found = rules.find("graph");
+
+  if (found == rules.end())
+    return;
+  if (!found->is_object()) {
+    throw MakefileException(this->_path + ": graph must be an object");
+  }
+  if (found->contains("root")) {
+    if (!found->at("root").is_string() || found->at("root").get<std::string>().empty()) {
+      throw MakefileException(this->_path + ": graph.root must be a non-empty string");
+    }
+    this->_root = found->at("root").get<std::string>();
+  }
+  if (found->contains("checks")) {
+    if (!found->at("checks").is_array()) {
+      throw MakefileException(this->_path + ": graph.checks must be an array of strings");
+    }
+    for (const json &check: found->at("checks")) {
+      if (check == "cycles")
+        this->_graphChecks |= CycleCheck;
+      else if (check == "unreachable")
+        this->_graphChecks |= UnreachableCheck;
+      else if (check == "phony")
+        this->_graphChecks |= PhonyCheck;
+      else {
+        throw MakefileException(this->_path + ": graph.checks: unknown check " + check.dump());
+      }
+    }
+  }
+}
+
+bool Rules::_loadCache(const struct stat &st, const uint64_t *sourceHash)
+{
+  MappedFile cache;
+  CacheHeader header;
+  const char *payload;
+  uint32_t graph[2];
+  size_t pos = 0;
+
+  if (this->_cachePath.empty())
+    return false;
+  try {
+    cache = MappedFile(this->_cachePath);
+  }
+  catch (const MakefileException &e) {
+    return false;
+  }
+  if (cache.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, cache.data(), sizeof(header));
+  if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion ||
+      header.headerSize != sizeof(header) || header.payloadSize != cache.size() - sizeof(header))
+    return false;
+  if (header.sourceSize != static_cast<uint64_t>(st.st_size))
+    return false;
+  if (sourceHash == nullptr ? header.sourceMtime != mtime(st) : header.sourceHash != *sourceHash)
+    return false;
+  payload = cache.data() + sizeof(header);
+  if (hash64(payload, header.payloadSize) != header.payloadHash)
+    return false;
+  try {
+    pos += this->_include.rules.load(payload + pos, header.payloadSize - pos);
+    pos += this->_include.variables.load(payload + pos, header.payloadSize - pos);
+    pos += this->_exclude.rules.load(payload + pos, header.payloadSize - pos);
+    pos += this->_exclude.variables.load(payload + pos, header.payloadSize - pos);
+  }
+  catch (const MakefileException &e) {
+    return false;
+  }
+  if (header.payloadSize - pos < sizeof(graph))
+    return false;
+  std::memcpy(graph, payload + pos, sizeof(graph));
+  pos += sizeof(graph);
+  if (graph[1] != header.payloadSize - pos)
+    return false;
+  this->_graphChecks = graph[0];
+  this->_root.assign(payload + pos, graph[1]);
+  this->_hash = header.payloadHash;
+  this->_cache = std::move(cache);
+  if (sourceHash != nullptr) {
+    int fd = open(this->_cachePath.c_str(), O_WRONLY | O_CLOEXEC);
+
+    header.sourceMtime = mtime(st);
+    if (fd >= 0) {
+      if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+        unlink(this->_cachePath.c_str());
+      close(fd);
+    }
+  }
+  return true;
+}
+
+void Rules::_saveCache(const struct stat &st, uint64_t sourceHash)
+{
+  std::string payload;
+  CacheHeader header;
+  uint32_t graph[2] = {this->_graphChecks, static_cast<uint32_t>(this->_root.size())};
+  std::string tmp = this->_cachePath + ".tmp." + std::to_string(getpid());
+  int fd;
+  bool written;
+
+  this->_include.rules.serialize(payload);
+  this->_include.variables.serialize(payload);
+  this->_exclude.rules.serialize(payload);
+  this->_exclude.variables.serialize(payload);
+  payload.append(reinterpret_cast<const char *>(graph), sizeof(graph));
+  payload += this->_root;
+  std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.headerSize = sizeof(header);
+  header.sourceSize = st.st_size;
+  header.sourceMtime = mtime(st);
+  header.sourceHash = sourceHash;
+  header.payloadSize = payload.size();
+  header.payloadHash = hash64(payload);
+  this->_hash = header.payloadHash;
+  if (this->_cachePath.empty())
+    return;
+  fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return;
+  written = writeAll(fd, reinterpret_cast<const char *>(&header), sizeof(header)) && writeAll(fd, payload.data(), payload.size());
+  close(fd);
+  if (!written || rename(tmp.c_str(), this->_cachePath.c_str()) != 0)
+    unlink(tmp.c_str());
 }
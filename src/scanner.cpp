@@ -0,0 +1,171 @@
+#include <cstring>
+#include "scanner.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define __SCANNER_X86
+#endif
+
+static inline void emitLine(const char *data, size_t &lineStart, size_t end, Scanner::Result &result)
+{
+  uint8_t flags = 0;
+
+  if (end > lineStart) {
+    if (data[lineStart] == '#')
+      flags |= Scanner::Comment;
+    if (data[end - 1] == '\\')
+      flags |= Scanner::Continuation;
+  }
+  result.lineEnds.push_back(end);
+  result.flags.push_back(flags);
+  lineStart = end + 1;
+}
+
+static void scanTail(const char *data, size_t pos, size_t size, size_t lineStart, Scanner::Result &result)
+{
+  for (; pos < size; pos++) {
+    if (data[pos] == '\n')
+      emitLine(data, lineStart, pos, result);
+    else if (data[pos] == '#')
+      result.hashes.push_back(pos);
+  }
+  if (lineStart < size)
+    emitLine(data, lineStart, size, result);
+}
+
+static void scanScalar(const char *data, size_t size, Scanner::Result &result)
+{
+  const char *hash = static_cast<const char *>(std::memchr(data, '#', size));
+  size_t lineStart = 0;
+
+  while (lineStart < size) {
+    const char *newline = static_cast<const char *>(std::memchr(data + lineStart, '\n', size - lineStart));
+    size_t end = (newline == nullptr ? size : newline - data);
+
+    for (; hash != nullptr && hash < data + end; hash = static_cast<const char *>(std::memchr(hash + 1, '#', data + size - hash - 1)))
+      result.hashes.push_back(hash - data);
+    emitLine(data, lineStart, end, result);
+  }
+}
+
+#ifdef __SCANNER_X86
+static inline void emitMasks(const char *data, size_t base, uint32_t newlines, uint32_t hashes, size_t &lineStart, Scanner::Result &result)
+{
+  while (hashes != 0) {
+    result.hashes.push_back(base + __builtin_ctz(hashes));
+    hashes &= hashes - 1;
+  }
+  while (newlines != 0) {
+    emitLine(data, lineStart, base + __builtin_ctz(newlines), result);
+    newlines &= newlines - 1;
+  }
+}
+
+__attribute__((target("sse2")))
+static void scanSse2(const char *data, size_t size, Scanner::Result &result)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i hash = _mm_set1_epi8('#');
+  size_t lineStart = 0;
+  size_t pos = 0;
+
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    uint32_t newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    uint32_t hashes = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, hash));
+
+    if ((newlines | hashes) != 0)
+      emitMasks(data, pos, newlines, hashes, lineStart, result);
+  }
+  scanTail(data, pos, size, lineStart, result);
+}
+
+__attribute__((target("avx2")))
+static void scanAvx2(const char *data, size_t size, Scanner::Result &result)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i hash = _mm256_set1_epi8('#');
+  size_t lineStart = 0;
+  size_t pos = 0;
+
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+    uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+    uint32_t hashes = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, hash));
+
+    if ((newlines | hashes) != 0)
+      emitMasks(data, pos, newlines, hashes, lineStart, result);
+  }
+  scanTail(data, pos, size, lineStart, result);
+}
+#endif
+
+void Scanner::Result::clear()
+{
+  this->lineEnds.clear();
+  this->flags.clear();
+  this->hashes.clear();
+}
+
+void Scanner::scan(std::string_view buffer, Result &result)
+{
+  static const Implementation implementation = Scanner::best();
+
+  Scanner::scan(buffer, result, implementation);
+}
+
+void Scanner::scan(std::string_view buffer, Result &result, Implementation implementation)
+{
+  result.clear();
+  result.lineEnds.reserve(buffer.size() / 32 + 1);
+  result.flags.reserve(buffer.size() / 32 + 1);
+  switch (implementation) {
+#ifdef __SCANNER_X86
+  case Avx2:
+    scanAvx2(buffer.data(), buffer.size(), result);
+    break;
+  case Sse2:
+    scanSse2(buffer.data(), buffer.size(), result);
+    break;
+#endif
+  default:
+    scanScalar(buffer.data(), buffer.size(), result);
+  }
+}
+
+Scanner::Implementation Scanner::best()
+{
+  if (Scanner::isSupported(Avx2))
+    return Avx2;
+  if (Scanner::isSupported(Sse2))
+    return Sse2;
+  return Scalar;
+}
+
+bool Scanner::isSupported(Implementation implementation)
+{
+  switch (implementation) {
+#ifdef __SCANNER_X86
+  case Avx2:
+    return __builtin_cpu_supports("avx2");
+  case Sse2:
+    return __builtin_cpu_supports("sse2");
+#endif
+  case Scalar:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *Scanner::name(Implementation implementation)
+{
+  switch (implementation) {
+  case Avx2:
+    return "avx2";
+  case Sse2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
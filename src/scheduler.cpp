@@ -0,0 +1,170 @@
+#include "scheduler.hpp"
+#include "stats.hpp"
+
+static thread_local const Scheduler *currentScheduler = nullptr;
+static thread_local int currentIndex = -1;
+
+Scheduler::Scheduler(unsigned int workers) : _queued(0), _tasks(0), _pending(0), _next(0), _stop(false)
+{
+  if (workers == 0)
+    workers = 1;
+  for (unsigned int i = 0; i < workers; i++)
+    this->_workers.push_back(std::make_unique<Worker>());
+  for (unsigned int i = 0; i < workers; i++)
+    this->_threads.emplace_back(&Scheduler::_run, this, i);
+}
+
+Scheduler::~Scheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_sleepMutex);
+
+    this->_stop = true;
+  }
+  this->_wake.notify_all();
+  for (std::thread &thread: this->_threads)
+    thread.join();
+}
+
+void Scheduler::submit(std::function<void()> job)
+{
+  this->_pending++;
+  this->_push(std::move(job), false);
+}
+
+void Scheduler::spawn(TaskGroup &group, std::function<void()> job)
+{
+  group._pending++;
+  this->_pending++;
+  this->_push([this, &group, job = std::move(job)]() {
+    job();
+    if (--group._pending == 0) {
+      std::lock_guard<std::mutex> lock(this->_sleepMutex);
+
+      this->_wake.notify_all();
+    }
+  }, true);
+}
+
+void Scheduler::wait()
+{
+  std::unique_lock<std::mutex> lock(this->_sleepMutex);
+
+  this->_done.wait(lock, [this]() { return this->_pending == 0; });
+}
+
+void Scheduler::wait(TaskGroup &group)
+{
+  int self = this->currentWorker();
+
+  while (group._pending > 0) {
+    if (this->_runOne(self, true))
+      continue;
+    std::unique_lock<std::mutex> lock(this->_sleepMutex);
+
+    this->_wake.wait(lock, [this, &group]() { return group._pending == 0 || this->_tasks > 0; });
+  }
+}
+
+unsigned int Scheduler::size() const
+{
+  return this->_workers.size();
+}
+
+int Scheduler::currentWorker() const
+{
+  return (currentScheduler == this ? currentIndex : -1);
+}
+
+void Scheduler::_push(std::function<void()> job, bool task)
+{
+  int self = this->currentWorker();
+  unsigned int index = (self >= 0 ? self : this->_next++ % this->_workers.size());
+
+  {
+    std::lock_guard<std::mutex> lock(this->_workers[index]->mutex);
+
+    (task ? this->_workers[index]->tasks : this->_workers[index]->jobs).push_back(std::move(job));
+  }
+  if (task)
+    this->_tasks++;
+  this->_queued++;
+  {
+    std::lock_guard<std::mutex> lock(this->_sleepMutex);
+  }
+  this->_wake.notify_all();
+}
+
+bool Scheduler::_pop(unsigned int self, std::function<void()> &job, bool task)
+{
+  Worker &worker = *this->_workers[self];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  std::deque<std::function<void()>> &jobs = (task ? worker.tasks : worker.jobs);
+
+  if (jobs.empty())
+    return false;
+  job = std::move(jobs.back());
+  jobs.pop_back();
+  return true;
+}
+
+bool Scheduler::_steal(unsigned int self, std::function<void()> &job, bool task)
+{
+  size_t count = this->_workers.size();
+
+  for (size_t i = 1; i <= count; i++) {
+    Worker &victim = *this->_workers[(self + i) % count];
+    std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+
+    if (!lock.owns_lock())
+      continue;
+    std::deque<std::function<void()>> &jobs = (task ? victim.tasks : victim.jobs);
+
+    if (jobs.empty())
+      continue;
+    job = std::move(jobs.front());
+    jobs.pop_front();
+    return true;
+  }
+  return false;
+}
+
+bool Scheduler::_runOne(int self, bool tasksOnly)
+{
+  std::function<void()> job;
+  unsigned int index = (self >= 0 ? self : 0);
+  bool task = true;
+
+  if (!(self >= 0 && this->_pop(index, job, true)) && !this->_steal(index, job, true)) {
+    task = false;
+    if (tasksOnly || (!(self >= 0 && this->_pop(index, job, false)) && !this->_steal(index, job, false)))
+      return false;
+  }
+  if (task)
+    this->_tasks--;
+  this->_queued--;
+  job();
+  if (--this->_pending == 0) {
+    std::lock_guard<std::mutex> lock(this->_sleepMutex);
+
+    this->_done.notify_all();
+  }
+  return true;
+}
+
+void Scheduler::_run(unsigned int self)
+{
+  Stats::Thread record;
+
+  currentScheduler = this;
+  currentIndex = self;
+  while (true) {
+    if (this->_runOne(self, false))
+      continue;
+    std::unique_lock<std::mutex> lock(this->_sleepMutex);
+
+    this->_wake.wait(lock, [this]() { return this->_stop || this->_queued > 0; });
+    if (this->_stop && this->_queued == 0)
+      return;
+  }
+}
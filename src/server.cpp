@@ -0,0 +1,427 @@
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "server.hpp"
+
+static const size_t maxRequest = 2 * PATH_MAX + 16;
+
+static std::string absolutePath(const std::string &path)
+{
+  char resolved[PATH_MAX];
+  char cwd[PATH_MAX];
+
+  if (realpath(path.c_str(), resolved) != nullptr)
+    return resolved;
+  if (!path.empty() && path[0] == '/')
+    return path;
+  if (getcwd(cwd, sizeof(cwd)) == nullptr)
+    return path;
+  return std::string(cwd) + "/" + path;
+}
+
+static std::string directoryOf(const std::string &path)
+{
+  size_t slash = path.find_last_of('/');
+
+  if (slash == std::string::npos)
+    return ".";
+  return (slash == 0 ? "/" : path.substr(0, slash));
+}
+
+static std::string fallbackDirectory()
+{
+  return "/tmp/checkmake-" + std::to_string(getuid());
+}
+
+static void privateDirectory(const std::string &path)
+{
+  struct stat info;
+
+  if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+    throw MakefileException("Failed to create " + path + ": " + std::strerror(errno));
+  }
+  if (lstat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+    throw MakefileException(path + " must be a directory private to the current user");
+  }
+}
+
+static sockaddr_un socketAddress(const std::string &path)
+{
+  sockaddr_un address;
+
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw MakefileException("Socket path too long: " + path);
+  }
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+Server::Server(const std::string &socketPath, const std::string &rulesPath, const std::vector<std::string> &includeDirectories, bool verbose) : _socketPath(socketPath), _rulesPath(absolutePath(rulesPath)), _verbose(verbose), _rules(std::make_unique<Rules>(rulesPath)), _includes(includeDirectories), _socket(-1), _inotify(-1), _signal(-1), _stop(false)
+{}
+
+Server::~Server()
+{
+  for (Client &client: this->_clients)
+    close(client.fd);
+  if (this->_socket >= 0) {
+    close(this->_socket);
+    unlink(this->_socketPath.c_str());
+  }
+  if (this->_inotify >= 0)
+    close(this->_inotify);
+  if (this->_signal >= 0)
+    close(this->_signal);
+}
+
+void Server::run()
+{
+  sigset_t signals;
+
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+  this->_signal = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  this->_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (this->_signal < 0 || this->_inotify < 0) {
+    throw MakefileException(std::string("Failed to start server: ") + std::strerror(errno));
+  }
+  this->_listen();
+  this->_watch(this->_rulesPath);
+  if (this->_verbose)
+    std::cerr << "checkmake: listening on " << this->_socketPath << std::endl;
+  while (!this->_stop) {
+    std::vector<pollfd> fds = {{this->_socket, POLLIN, 0}, {this->_inotify, POLLIN, 0}, {this->_signal, POLLIN, 0}};
+
+    for (const Client &client: this->_clients)
+      fds.push_back({client.fd, static_cast<short>(client.out.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      throw MakefileException(std::string("poll failed: ") + std::strerror(errno));
+    }
+    if (fds[2].revents & POLLIN)
+      this->_stop = true;
+    if (fds[1].revents & POLLIN)
+      this->_events();
+    for (size_t i = 3; i < fds.size(); i++) {
+      Client &client = this->_clients[i - 3];
+
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        this->_read(client);
+      if (!client.out.empty() && (fds[i].revents & POLLOUT))
+        this->_write(client);
+    }
+    for (auto it = this->_clients.begin(); it != this->_clients.end();) {
+      if (it->closed && it->out.empty()) {
+        close(it->fd);
+        it = this->_clients.erase(it);
+      }
+      else
+        it++;
+    }
+    if (fds[0].revents & POLLIN)
+      this->_accept();
+  }
+}
+
+int Server::request(const std::string &socketPath, const std::string &makefilePath, std::ostream &out)
+{
+  sockaddr_un address = socketAddress(socketPath);
+  std::string query = "CHECK " + absolutePath(makefilePath) + "\t" + makefilePath + "\n";
+  std::string reply;
+  char buffer[65536];
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  size_t header;
+  int status;
+  size_t length;
+
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    if (fd >= 0)
+      close(fd);
+    throw MakefileException("Failed to connect to " + socketPath);
+  }
+  for (size_t sent = 0; sent < query.size();) {
+    ssize_t written = write(fd, query.data() + sent, query.size() - sent);
+
+    if (written <= 0) {
+      close(fd);
+      throw MakefileException("Failed to send request to " + socketPath);
+    }
+    sent += written;
+  }
+  while ((header = reply.find('\n')) == std::string::npos || reply.size() < header + 1 + std::strtoul(reply.c_str() + reply.find(' ') + 1, nullptr, 10)) {
+    ssize_t received = read(fd, buffer, sizeof(buffer));
+
+    if (received <= 0) {
+      close(fd);
+      throw MakefileException("Connection to " + socketPath + " closed");
+    }
+    reply.append(buffer, received);
+  }
+  close(fd);
+  status = std::atoi(reply.c_str());
+  length = std::strtoul(reply.c_str() + reply.find(' ') + 1, nullptr, 10);
+  out.write(reply.data() + header + 1, length);
+  return status;
+}
+
+std::string Server::defaultSocketPath()
+{
+  const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+
+  if (runtime != nullptr && *runtime != '\0')
+    return std::string(runtime) + "/checkmake.sock";
+  return fallbackDirectory() + "/checkmake.sock";
+}
+
+void Server::_listen()
+{
+  sockaddr_un address = socketAddress(this->_socketPath);
+  mode_t mask;
+  bool bound;
+
+  if (directoryOf(this->_socketPath) == fallbackDirectory())
+    privateDirectory(fallbackDirectory());
+  this->_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (this->_socket < 0) {
+    throw MakefileException(std::string("Failed to create socket: ") + std::strerror(errno));
+  }
+  unlink(this->_socketPath.c_str());
+  mask = umask(0177);
+  bound = (bind(this->_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+  umask(mask);
+  if (!bound || listen(this->_socket, 128) != 0) {
+    throw MakefileException("Failed to listen on " + this->_socketPath + ": " + std::strerror(errno));
+  }
+}
+
+void Server::_accept()
+{
+  int fd;
+
+  while ((fd = accept4(this->_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || peer.uid != getuid()) {
+      close(fd);
+      continue;
+    }
+    this->_clients.push_back({fd, std::string(), std::string(), false});
+  }
+}
+
+void Server::_read(Client &client)
+{
+  char buffer[4096];
+  ssize_t received;
+  size_t eol;
+
+  while (!client.closed && (received = read(client.fd, buffer, sizeof(buffer))) > 0) {
+    client.in.append(buffer, received);
+    while ((eol = client.in.find('\n')) != std::string::npos) {
+      std::string line = client.in.substr(0, eol);
+
+      client.in.erase(0, eol + 1);
+      this->_handle(client, line);
+    }
+    if (client.in.size() > maxRequest) {
+      client.in.clear();
+      client.closed = true;
+    }
+  }
+  if (!client.closed && (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)))
+    client.closed = true;
+  this->_write(client);
+}
+
+void Server::_write(Client &client)
+{
+  while (!client.out.empty()) {
+    ssize_t written = write(client.fd, client.out.data(), client.out.size());
+
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (written <= 0) {
+      client.out.clear();
+      client.closed = true;
+      return;
+    }
+    client.out.erase(0, written);
+  }
+}
+
+void Server::_handle(Client &client, const std::string &line)
+{
+  std::ostringstream payload;
+  std::string path;
+  std::string display;
+  int status = 0;
+
+  if (line == "SHUTDOWN") {
+    this->_stop = true;
+    client.out += "0 0\n";
+    return;
+  }
+  if (line.compare(0, 6, "CHECK ") != 0) {
+    payload << "checkmake: unknown request '" << line << "'\n";
+    status = 2;
+  }
+  else {
+    size_t tab = line.find('\t', 6);
+
+    path = line.substr(6, tab == std::string::npos ? std::string::npos : tab - 6);
+    display = (tab == std::string::npos ? path : line.substr(tab + 1));
+    auto found = this->_entries.find(path);
+
+    if (found == this->_entries.end()) {
+      found = this->_entries.emplace(path, Entry()).first;
+      this->_watch(path);
+      this->_load(path, found->second);
+    }
+    if (!found->second.error.empty()) {
+      payload << "checkmake: " << found->second.error << "\n";
+      status = 1;
+    }
+    else {
+      TextSink sink(payload);
+
+      found->second.diagnostics.replay(sink, display);
+      status = (found->second.diagnostics.size() > 0 ? 1 : 0);
+    }
+  }
+  std::string body = payload.str();
+
+  client.out += std::to_string(status) + " " + std::to_string(body.size()) + "\n";
+  client.out += body;
+}
+
+void Server::_events()
+{
+  alignas(inotify_event) char buffer[65536];
+  ssize_t received;
+
+  while ((received = read(this->_inotify, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t pos = 0; pos < received;) {
+      const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + pos);
+      auto directory = this->_directories.find(event->wd);
+
+      pos += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        this->_reloadRules();
+        for (auto &[path, entry]: this->_entries) {
+          if (entry.makefile != nullptr) {
+            for (const std::shared_ptr<const Makefile> &fragment: entry.makefile->included())
+              this->_includes.invalidate(fragment->getPath());
+          }
+          this->_load(path, entry);
+        }
+        continue;
+      }
+      if (directory == this->_directories.end() || event->len == 0)
+        continue;
+      std::string path = directory->second + "/" + event->name;
+
+      if (path == this->_rulesPath)
+        this->_reloadRules();
+      else {
+        auto found = this->_entries.find(path);
+
+        if (found != this->_entries.end())
+          this->_load(path, found->second);
+        if (this->_includes.invalidate(path))
+          this->_refresh(path);
+      }
+    }
+  }
+}
+
+void Server::_watch(const std::string &path)
+{
+  std::string directory = directoryOf(path);
+  int wd = inotify_add_watch(this->_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+
+  if (wd >= 0)
+    this->_directories[wd] = directory;
+}
+
+void Server::_load(const std::string &path, Entry &entry)
+{
+  entry.error.clear();
+  try {
+    MappedFile file(path);
+
+    if (entry.makefile != nullptr)
+      entry.makefile->update(file.view());
+    else
+      entry.makefile = std::make_unique<Makefile>(path, std::string(file.view()));
+    this->_include(entry);
+  }
+  catch (const MakefileException &e) {
+    entry.makefile.reset();
+    entry.error = e.what();
+  }
+  this->_check(entry);
+  if (this->_verbose)
+    std::cerr << "checkmake: parsed " << path << std::endl;
+}
+
+void Server::_check(Entry &entry)
+{
+  entry.diagnostics = DiagnosticBuffer();
+  if (entry.makefile != nullptr)
+    this->_rules->check(*entry.makefile, entry.diagnostics);
+}
+
+void Server::_include(Entry &entry)
+{
+  entry.makefile->resolveIncludes(this->_includes);
+  for (const std::shared_ptr<const Makefile> &fragment: entry.makefile->included())
+    this->_watch(fragment->getPath());
+}
+
+void Server::_refresh(const std::string &path)
+{
+  for (auto &[name, entry]: this->_entries) {
+    if (entry.makefile == nullptr)
+      continue;
+    const std::vector<std::shared_ptr<const Makefile>> &included = entry.makefile->included();
+
+    if (std::none_of(included.begin(), included.end(), [&path](const std::shared_ptr<const Makefile> &fragment) { return fragment->getPath() == path; }))
+      continue;
+    this->_include(entry);
+    this->_check(entry);
+    if (this->_verbose)
+      std::cerr << "checkmake: re-checked " << name << " after " << path << " changed" << std::endl;
+  }
+}
+
+void Server::_reloadRules()
+{
+  try {
+    this->_rules = std::make_unique<Rules>(this->_rulesPath);
+  }
+  catch (const MakefileException &e) {
+    std::cerr << "checkmake: keeping previous rules: " << e.what() << std::endl;
+    return;
+  }
+  for (auto &[path, entry]: this->_entries)
+    this->_check(entry);
+  if (this->_verbose)
+    std::cerr << "checkmake: reloaded " << this->_rulesPath << std::endl;
+}
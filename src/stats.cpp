@@ -0,0 +1,259 @@
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "stats.hpp"
+#include "trace.hpp"
+
+static const char *phaseNames[Stats::phases] = {
+  "read", "clean", "extract", "includes", "check", "rules", "walk", "output"
+};
+
+static thread_local size_t threadAllocations = 0;
+static thread_local size_t threadAllocated = 0;
+static thread_local Stats::Record *currentRecord = nullptr;
+static thread_local Stats::Timer *currentTimer = nullptr;
+static std::atomic<bool> statsEnabled(false);
+static std::mutex recordsMutex;
+static std::vector<Stats::Record> fileRecords;
+static std::vector<Stats::Record> threadRecords;
+static Stats::Record processRecord = {};
+static std::chrono::steady_clock::time_point processStart;
+
+static void countAllocation(size_t size)
+{
+  if (!statsEnabled.load(std::memory_order_relaxed))
+    return;
+  threadAllocations++;
+  threadAllocated += size;
+}
+
+void *operator new(size_t size)
+{
+  void *ptr = std::malloc(size == 0 ? 1 : size);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  countAllocation(size);
+  return ptr;
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  size_t align = std::max(static_cast<size_t>(alignment), sizeof(void *));
+  size_t rounded = (size == 0 ? align : (size + align - 1) / align * align);
+  void *ptr = std::aligned_alloc(align, rounded);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  countAllocation(size);
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+static double threadCpu()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds(const struct timeval &tv)
+{
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+double Stats::Record::total() const
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < phases; i++)
+    sum += this->wall[i];
+  return sum;
+}
+
+Stats::Timer::Timer(Phase phase) : _record(currentRecord), _parent(nullptr), _phase(phase), _traced(Trace::enabled()), _cpu(0), _allocations(0), _nestedWall(0), _nestedCpu(0), _nestedAllocations(0)
+{
+  if (this->_record == nullptr && !this->_traced)
+    return;
+  this->_wall = std::chrono::steady_clock::now();
+  if (this->_record == nullptr)
+    return;
+  this->_parent = currentTimer;
+  currentTimer = this;
+  this->_cpu = threadCpu();
+  this->_allocations = threadAllocations;
+}
+
+Stats::Timer::~Timer()
+{
+  if (this->_traced)
+    Trace::complete(phaseNames[this->_phase], this->_wall);
+  if (this->_record == nullptr)
+    return;
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - this->_wall;
+  double cpu = threadCpu() - this->_cpu;
+  size_t allocations = threadAllocations - this->_allocations;
+
+  this->_record->wall[this->_phase] += wall.count() - this->_nestedWall;
+  this->_record->cpu[this->_phase] += cpu - this->_nestedCpu;
+  this->_record->allocations[this->_phase] += allocations - this->_nestedAllocations;
+  currentTimer = this->_parent;
+  if (this->_parent != nullptr && this->_parent->_record == this->_record) {
+    this->_parent->_nestedWall += wall.count();
+    this->_parent->_nestedCpu += cpu;
+    this->_parent->_nestedAllocations += allocations;
+  }
+}
+
+Stats::File::File(const std::string &path) : _record(), _previous(currentRecord), _enabled(statsEnabled.load(std::memory_order_relaxed)), _traced(Trace::enabled()), _previousFile(Trace::noFile)
+{
+  if (this->_traced) {
+    this->_begin = std::chrono::steady_clock::now();
+    this->_previousFile = Trace::enter(path);
+  }
+  if (!this->_enabled)
+    return;
+  this->_record.path = path;
+  currentRecord = &this->_record;
+}
+
+Stats::File::~File()
+{
+  if (this->_traced)
+    Trace::leave(this->_previousFile, this->_begin);
+  if (!this->_enabled)
+    return;
+  currentRecord = this->_previous;
+
+  std::lock_guard<std::mutex> lock(recordsMutex);
+
+  fileRecords.push_back(std::move(this->_record));
+}
+
+Stats::Thread::Thread() : _record(), _enabled(statsEnabled.load(std::memory_order_relaxed))
+{
+  if (!this->_enabled)
+    return;
+  this->_record.path = "(worker)";
+  currentRecord = &this->_record;
+}
+
+Stats::Thread::~Thread()
+{
+  if (!this->_enabled)
+    return;
+  currentRecord = nullptr;
+
+  std::lock_guard<std::mutex> lock(recordsMutex);
+
+  threadRecords.push_back(std::move(this->_record));
+}
+
+void Stats::enable()
+{
+  statsEnabled = true;
+  processStart = std::chrono::steady_clock::now();
+  processRecord.path = "(process)";
+  currentRecord = &processRecord;
+}
+
+bool Stats::enabled()
+{
+  return statsEnabled.load(std::memory_order_relaxed);
+}
+
+void Stats::bytes(size_t count)
+{
+  if (currentRecord != nullptr)
+    currentRecord->bytes += count;
+}
+
+void Stats::lines(size_t physical, size_t logical)
+{
+  if (currentRecord != nullptr) {
+    currentRecord->physicalLines += physical;
+    currentRecord->logicalLines += logical;
+  }
+}
+
+size_t Stats::allocations()
+{
+  return threadAllocations;
+}
+
+size_t Stats::allocatedBytes()
+{
+  return threadAllocated;
+}
+
+void Stats::report(std::ostream &out, size_t slowest)
+{
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - processStart;
+  Record total = processRecord;
+  std::vector<const Record *> files;
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  for (const Record &record: fileRecords)
+    files.push_back(&record);
+  for (const std::vector<Record> *records: {&fileRecords, &threadRecords}) {
+    for (const Record &record: *records) {
+      for (size_t i = 0; i < phases; i++) {
+        total.wall[i] += record.wall[i];
+        total.cpu[i] += record.cpu[i];
+        total.allocations[i] += record.allocations[i];
+      }
+      total.bytes += record.bytes;
+      total.physicalLines += record.physicalLines;
+      total.logicalLines += record.logicalLines;
+    }
+  }
+  out << std::fixed << std::setprecision(3);
+  out << "=== checkmake stats ===" << "\n";
+  out << "files: " << fileRecords.size() << "\n";
+  out << "wall: " << elapsed.count() * 1e3 << " ms, cpu: " << (seconds(usage.ru_utime) + seconds(usage.ru_stime)) * 1e3 << " ms\n";
+  out << "bytes read: " << total.bytes << "\n";
+  out << "lines: " << total.physicalLines << " physical, " << total.logicalLines << " logical\n";
+  out << "peak rss: " << usage.ru_maxrss << " KB\n";
+  out << std::left << std::setw(10) << "phase" << std::right << std::setw(14) << "wall ms" << std::setw(14) << "cpu ms" << std::setw(14) << "allocations" << "\n";
+  for (size_t i = 0; i < phases; i++) {
+    out << std::left << std::setw(10) << phaseNames[i] << std::right
+        << std::setw(14) << total.wall[i] * 1e3
+        << std::setw(14) << total.cpu[i] * 1e3
+        << std::setw(14) << total.allocations[i] << "\n";
+  }
+  if (slowest == 0 || files.empty())
+    return;
+  slowest = std::min(slowest, files.size());
+  std::partial_sort(files.begin(), files.begin() + slowest, files.end(), [](const Record *a, const Record *b) { return a->total() > b->total(); });
+  out << "slowest files:" << "\n";
+  for (size_t i = 0; i < slowest; i++)
+    out << std::setw(12) << files[i]->total() * 1e3 << " ms  " << files[i]->path << "\n";
+}
@@ -0,0 +1,158 @@
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "exception.hpp"
+#include "trace.hpp"
+
+struct Event {
+  Trace::Clock::time_point begin;
+  Trace::Clock::time_point end;
+  const char *name;
+  uint32_t file;
+};
+
+struct Buffer {
+  std::unique_ptr<Event[]> events;
+  std::atomic<uint64_t> head;
+  uint32_t file;
+  uint32_t tid;
+};
+
+static std::atomic<bool> traceEnabled(false);
+static Trace::Clock::time_point traceStart;
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<Buffer>> buffers;
+static std::mutex filesMutex;
+static std::unordered_map<std::string, uint32_t> fileIds;
+static std::vector<const std::string *> files;
+static thread_local Buffer *threadBuffer = nullptr;
+
+static Buffer &buffer()
+{
+  if (threadBuffer == nullptr) {
+    std::unique_ptr<Buffer> created = std::make_unique<Buffer>();
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    created->events = std::make_unique<Event[]>(Trace::capacity);
+    created->head = 0;
+    created->file = Trace::noFile;
+    created->tid = buffers.size();
+    threadBuffer = created.get();
+    buffers.push_back(std::move(created));
+  }
+  return *threadBuffer;
+}
+
+static void push(Buffer &buffer, const Event &event)
+{
+  uint64_t head = buffer.head.load(std::memory_order_relaxed);
+
+  buffer.events[head % Trace::capacity] = event;
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+static void escape(std::ostream &out, const std::string &text)
+{
+  for (char c: text) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+    else
+      out << c;
+  }
+}
+
+static double microseconds(Trace::Clock::time_point time)
+{
+  return std::chrono::duration<double, std::micro>(time - traceStart).count();
+}
+
+void Trace::enable()
+{
+  traceStart = Clock::now();
+  traceEnabled = true;
+  buffer();
+}
+
+bool Trace::enabled()
+{
+  return traceEnabled.load(std::memory_order_relaxed);
+}
+
+uint32_t Trace::enter(const std::string &path)
+{
+  Buffer &current = buffer();
+  uint32_t previous = current.file;
+
+  std::lock_guard<std::mutex> lock(filesMutex);
+  auto found = fileIds.emplace(path, files.size());
+
+  if (found.second)
+    files.push_back(&found.first->first);
+  current.file = found.first->second;
+  return previous;
+}
+
+void Trace::leave(uint32_t previous, Clock::time_point begin)
+{
+  Buffer &current = buffer();
+
+  push(current, {begin, Clock::now(), nullptr, current.file});
+  current.file = previous;
+}
+
+void Trace::complete(const char *name, Clock::time_point begin)
+{
+  Buffer &current = buffer();
+
+  push(current, {begin, Clock::now(), name, current.file});
+}
+
+void Trace::write(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  std::lock_guard<std::mutex> filesLock(filesMutex);
+  std::ofstream out(path);
+  uint64_t dropped = 0;
+  bool first = true;
+
+  if (!out)
+    throw MakefileException("cannot write trace file " + path);
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  for (const std::unique_ptr<Buffer> &current: buffers) {
+    uint64_t head = current->head.load(std::memory_order_acquire);
+    uint64_t tail = (head > capacity ? head - capacity : 0);
+
+    dropped += tail;
+    out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << current->tid
+        << ",\"args\":{\"name\":\"" << (current->tid == 0 ? "main" : "worker " + std::to_string(current->tid)) << "\"}}";
+    first = false;
+    for (uint64_t i = tail; i < head; i++) {
+      const Event &event = current->events[i % capacity];
+
+      out << ",\n{\"name\":\"";
+      if (event.name != nullptr)
+        out << event.name;
+      else
+        escape(out, *files[event.file]);
+      out << "\",\"cat\":\"" << (event.name != nullptr ? "phase" : "file") << "\",\"ph\":\"X\""
+          << ",\"ts\":" << microseconds(event.begin)
+          << ",\"dur\":" << std::chrono::duration<double, std::micro>(event.end - event.begin).count()
+          << ",\"pid\":1,\"tid\":" << current->tid;
+      if (event.name != nullptr && event.file != noFile) {
+        out << ",\"args\":{\"file\":\"";
+        escape(out, *files[event.file]);
+        out << "\"}";
+      }
+      out << "}";
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << dropped << "}}\n";
+  if (!out)
+    throw MakefileException("cannot write trace file " + path);
+}
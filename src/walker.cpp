@@ -0,0 +1,90 @@
+#include <sys/stat.h>
+#include <dirent.h>
+#include <algorithm>
+#include "stats.hpp"
+#include "utils.hpp"
+#include "walker.hpp"
+
+Walker::Walker(const std::vector<std::string> &skipDirectories) : _skipDirectories(skipDirectories)
+{}
+
+std::vector<std::string> Walker::discover(const std::string &root, Scheduler &pool)
+{
+  Stats::Timer timer(Stats::Walk);
+  std::vector<std::string> found;
+
+  pool.submit([this, root, &pool]() { this->_walk(root, pool); });
+  pool.wait();
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    found.swap(this->_found);
+  }
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+bool Walker::isMakefile(std::string_view name)
+{
+  return name == "Makefile" || name == "makefile" || name == "GNUmakefile" || (name.size() > 3 && ends_with(name, ".mk"));
+}
+
+std::string Walker::root(const std::string &path)
+{
+  struct stat st;
+  size_t slash;
+
+  if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    return path;
+  slash = path.find_last_of('/');
+  if (slash == std::string::npos)
+    return ".";
+  if (slash == 0)
+    return "/";
+  return path.substr(0, slash);
+}
+
+void Walker::_walk(const std::string &directory, Scheduler &pool)
+{
+  std::vector<std::string> found;
+  DIR *dir = opendir(directory.c_str());
+  struct dirent *entry;
+
+  if (dir == nullptr)
+    return;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string_view name(entry->d_name);
+    std::string path;
+    unsigned char type = entry->d_type;
+
+    if (name == "." || name == "..")
+      continue;
+    path = (directory == "/" ? directory : directory + "/");
+    path += name;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+      struct stat st;
+
+      if ((type == DT_LNK ? stat(path.c_str(), &st) : lstat(path.c_str(), &st)) != 0)
+        continue;
+      if (S_ISREG(st.st_mode))
+        type = DT_REG;
+      else if (S_ISDIR(st.st_mode) && entry->d_type == DT_UNKNOWN)
+        type = DT_DIR;
+    }
+    if (type == DT_DIR && !this->_isSkipped(name))
+      pool.submit([this, path, &pool]() { this->_walk(path, pool); });
+    else if (type == DT_REG && Walker::isMakefile(name))
+      found.push_back(std::move(path));
+  }
+  closedir(dir);
+  if (!found.empty()) {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    std::move(found.begin(), found.end(), std::back_inserter(this->_found));
+  }
+}
+
+bool Walker::_isSkipped(std::string_view name) const
+{
+  return std::find(this->_skipDirectories.begin(), this->_skipDirectories.end(), name) != this->_skipDirectories.end();
+}